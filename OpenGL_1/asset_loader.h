@@ -0,0 +1,104 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include "thread_pool.h"
+#include "model.h"
+#include "texture_streamer.h"
+
+#include "glm/glm.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+using namespace std;
+
+//parses meshes and decodes images on the shared job pool, the finished CPU side payloads queue up
+//for the GL thread, which turns them into buffers and textures a little at a time in update()
+//nothing here blocks, models just draw nothing until their meshes are in and textures sharpen as they stream
+class AssetLoader {
+public:
+	explicit AssetLoader(ThreadPool& pool) : pool(pool), textures(pool) {}
+	//jobs post into the members below, so ours have to be done before those go away
+	~AssetLoader() {
+		pool.wait(work);
+	}
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	//model has to stay put until its upload has run, format is how its vertices are stored on the GPU
+	void loadModel(Model& model, const string& path, VertexFormat format = VERTEX_FULL) {
+		pending++;
+		pool.submit([this, &model, path, format] {
+			shared_ptr<ModelData> data = Model::loadCpu(path, false, format);
+			postUpload([this, &model, data] {
+				if (data) {
+					model.upload(*data, &textures);
+				}
+				pending--;
+			});
+		}, &work);
+	}
+	//GL thread only, the id is usable right away and shows black until the faces are in
+	unsigned int loadCubemap(const vector<string>& faces) {
+		return textures.requestCubemap(faces, glm::vec4(0.f, 0.f, 0.f, 1.f));
+	}
+
+	//GL thread only, once a frame: creates the meshes that are ready and streams up to textureBudget bytes of texels
+	void update(size_t textureBudget) {
+		deque<function<void()>> ready;
+		{
+			lock_guard<mutex> lock(uploadMutex);
+			ready.swap(uploads);
+		}
+		for (unsigned int i = 0; i < ready.size(); i++) {
+			ready[i]();
+		}
+		textures.update(textureBudget);
+	}
+	//models still loading
+	unsigned int modelsPending() const {
+		return pending;
+	}
+	//textures still decoding or streaming
+	unsigned int texturesPending() const {
+		return textures.pending();
+	}
+	size_t textureBytesLastFrame() const {
+		return textures.bytesLastUpdate;
+	}
+	//textures mapped from their .texcache vs baked this run
+	unsigned int texturesFromCache() const {
+		return textures.cacheHits;
+	}
+	unsigned int texturesBaked() const {
+		return textures.baked;
+	}
+	bool compressingTextures() const {
+		return textures.compressing();
+	}
+	bool idle() const {
+		return pending == 0 && textures.idle();
+	}
+	unsigned int workerCount() const {
+		return pool.size();
+	}
+private:
+	ThreadPool& pool;
+	TextureStreamer textures;
+	mutex uploadMutex;
+	deque<function<void()>> uploads;
+	atomic<unsigned int> pending{ 0 }; //models whose upload hasn't run yet
+	JobCounter work; //imports still on the pool
+
+	void postUpload(function<void()> upload) {
+		lock_guard<mutex> lock(uploadMutex);
+		uploads.push_back(move(upload));
+	}
+};
+
+#endif
@@ -0,0 +1,305 @@
+#ifndef BARNES_HUT_H
+#define BARNES_HUT_H
+
+#include "simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+//cells with this many bodies or fewer stop splitting, each leaf walks the tree once for all of its bodies
+const unsigned int BH_LEAF_SIZE = 32;
+//bits per axis in a morton code, 3 * 21 fits in 64
+const unsigned int BH_MAX_DEPTH = 21;
+
+//spreads the low 21 bits of v out to every third bit
+inline uint64_t spreadBits21(uint64_t v) {
+	v &= 0x1FFFFF;
+	v = (v | v << 32) & 0x1F00000000FFFFull;
+	v = (v | v << 16) & 0x1F0000FF0000FFull;
+	v = (v | v << 8) & 0x100F00F00F00F00Full;
+	v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+inline uint64_t mortonCode(uint32_t x, uint32_t y, uint32_t z) {
+	return spreadBits21(x) | spreadBits21(y) << 1 | spreadBits21(z) << 2;
+}
+
+//point masses one leaf's bodies are pulled by, padded with massless ones to a multiple of 8 for the SIMD sum
+struct InteractionList {
+	vector<float> x, y, z, m;
+	unsigned int size = 0;
+
+	void clear() {
+		size = 0;
+	}
+	void push(float px, float py, float pz, float pm) {
+		if (size + 8 > x.size()) {
+			unsigned int capacity = max(64u, (unsigned int)x.size() * 2);
+			x.resize(capacity);
+			y.resize(capacity);
+			z.resize(capacity);
+			m.resize(capacity);
+		}
+		x[size] = px;
+		y[size] = py;
+		z[size] = pz;
+		m[size] = pm;
+		size++;
+	}
+	unsigned int padded() {
+		unsigned int count = (size + 7) / 8 * 8;
+		for (unsigned int i = size; i < count; i++) {
+			x[i] = y[i] = z[i] = m[i] = 0.f;
+		}
+		return count;
+	}
+};
+
+//octree over morton sorted bodies, rebuilt from scratch every step
+//nodes sit in depth first order and each one knows where its subtree ends, so the force walk is a flat loop
+//that either takes a node's pull and skips its subtree or steps into its first child, no stack and no pointers
+//the walk is done once per leaf against the leaf's bounds, and every body in the leaf then sums the same list
+class BarnesHutTree {
+public:
+	struct Node {
+		float x, y, z; //center of mass
+		float mass;
+		float size; //cell edge length
+		uint32_t next; //first node after this subtree
+		uint32_t first; //leaves only, range of sorted bodies
+		uint32_t count; //0 for inner nodes
+	};
+	vector<Node> nodes;
+	vector<uint32_t> order; //sorted position -> body index
+	vector<uint32_t> leaves; //node index of every leaf, in morton order
+	double buildMilliseconds = 0.0;
+
+	void build(const float* x, const float* y, const float* z, const float* m, unsigned int n) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		nodes.clear();
+		leaves.clear();
+		order.resize(n);
+		if (n == 0) {
+			buildMilliseconds = 0.0;
+			return;
+		}
+		//bounding cube
+		float lo[3] = { x[0], y[0], z[0] }, hi[3] = { x[0], y[0], z[0] };
+		for (unsigned int i = 1; i < n; i++) {
+			lo[0] = min(lo[0], x[i]);
+			lo[1] = min(lo[1], y[i]);
+			lo[2] = min(lo[2], z[i]);
+			hi[0] = max(hi[0], x[i]);
+			hi[1] = max(hi[1], y[i]);
+			hi[2] = max(hi[2], z[i]);
+		}
+		float size = max(hi[0] - lo[0], max(hi[1] - lo[1], hi[2] - lo[2]));
+		size = size > 0.f ? size * 1.0001f : 1.f;
+		float scale = (float)((1u << BH_MAX_DEPTH) - 1) / size;
+
+		codes.resize(n);
+		for (unsigned int i = 0; i < n; i++) {
+			codes[i] = mortonCode((uint32_t)((x[i] - lo[0]) * scale), (uint32_t)((y[i] - lo[1]) * scale), (uint32_t)((z[i] - lo[2]) * scale));
+			order[i] = i;
+		}
+		radixSort(n);
+
+		//sorted copies, so a leaf's bodies sit next to each other in memory
+		sx.resize(n);
+		sy.resize(n);
+		sz.resize(n);
+		sm.resize(n);
+		for (unsigned int k = 0; k < n; k++) {
+			sx[k] = x[order[k]];
+			sy[k] = y[order[k]];
+			sz[k] = z[order[k]];
+			sm[k] = m[order[k]];
+		}
+		nodes.reserve(n / 2 + 1);
+		buildNode(0, n, 0, size);
+		buildMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	//accelerations for the bodies in leaves [begin, end), written back by body index
+	void accelerations(unsigned int begin, unsigned int end, float theta2, float eps2, bool simd, float* ax, float* ay, float* az) const {
+		static thread_local InteractionList list;
+		for (unsigned int l = begin; l < end; l++) {
+			const Node& leaf = nodes[leaves[l]];
+			gather(leaf, theta2, list);
+			unsigned int count = list.padded();
+			for (uint32_t k = leaf.first; k < leaf.first + leaf.count; k++) {
+				uint32_t i = order[k];
+#ifdef SIMD_X86
+				if (simd) {
+					sumAVX2(sx[k], sy[k], sz[k], list, count, eps2, ax[i], ay[i], az[i]);
+					continue;
+				}
+#endif
+				sumScalar(sx[k], sy[k], sz[k], list, eps2, ax[i], ay[i], az[i]);
+			}
+		}
+	}
+private:
+	vector<uint64_t> codes;
+	vector<uint64_t> codesScratch;
+	vector<uint32_t> orderScratch;
+	vector<float> sx, sy, sz, sm;
+
+	//everything that pulls on a leaf, cells far enough from every body in it go in whole, the rest get opened
+	//distance is measured from the nearest point of the leaf's bounds, so the angle holds for each body in it
+	void gather(const Node& leaf, float theta2, InteractionList& list) const {
+		float lo[3] = { sx[leaf.first], sy[leaf.first], sz[leaf.first] };
+		float hi[3] = { lo[0], lo[1], lo[2] };
+		for (uint32_t k = leaf.first + 1; k < leaf.first + leaf.count; k++) {
+			lo[0] = min(lo[0], sx[k]);
+			lo[1] = min(lo[1], sy[k]);
+			lo[2] = min(lo[2], sz[k]);
+			hi[0] = max(hi[0], sx[k]);
+			hi[1] = max(hi[1], sy[k]);
+			hi[2] = max(hi[2], sz[k]);
+		}
+		list.clear();
+		uint32_t end = (uint32_t)nodes.size();
+		uint32_t i = 0;
+		while (i < end) {
+			const Node& node = nodes[i];
+			float dx = max(max(lo[0] - node.x, node.x - hi[0]), 0.f);
+			float dy = max(max(lo[1] - node.y, node.y - hi[1]), 0.f);
+			float dz = max(max(lo[2] - node.z, node.z - hi[2]), 0.f);
+			if (node.size * node.size < theta2 * (dx * dx + dy * dy + dz * dz)) {
+				list.push(node.x, node.y, node.z, node.mass);
+				i = node.next;
+			} else if (node.count > 0) {
+				for (uint32_t k = node.first; k < node.first + node.count; k++) {
+					list.push(sx[k], sy[k], sz[k], sm[k]);
+				}
+				i = node.next;
+			} else {
+				i++;
+			}
+		}
+	}
+	//a body's own entry adds nothing since its d is zero
+	static void sumScalar(float x, float y, float z, const InteractionList& list, float eps2, float& ax, float& ay, float& az) {
+		float sumX = 0.f, sumY = 0.f, sumZ = 0.f;
+		for (unsigned int j = 0; j < list.size; j++) {
+			float dx = list.x[j] - x, dy = list.y[j] - y, dz = list.z[j] - z;
+			float inv = 1.f / sqrtf(dx * dx + dy * dy + dz * dz + eps2);
+			float s = list.m[j] * inv * inv * inv;
+			sumX += dx * s;
+			sumY += dy * s;
+			sumZ += dz * s;
+		}
+		ax = sumX;
+		ay = sumY;
+		az = sumZ;
+	}
+#ifdef SIMD_X86
+	SIMD_AVX2_TARGET static void sumAVX2(float x, float y, float z, const InteractionList& list, unsigned int count, float eps2,
+		float& ax, float& ay, float& az) {
+		const __m256 e = _mm256_set1_ps(eps2);
+		const __m256 one = _mm256_set1_ps(1.f);
+		__m256 xi = _mm256_set1_ps(x), yi = _mm256_set1_ps(y), zi = _mm256_set1_ps(z);
+		__m256 sumX = _mm256_setzero_ps(), sumY = _mm256_setzero_ps(), sumZ = _mm256_setzero_ps();
+		for (unsigned int j = 0; j < count; j += 8) {
+			__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&list.x[j]), xi);
+			__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&list.y[j]), yi);
+			__m256 dz = _mm256_sub_ps(_mm256_loadu_ps(&list.z[j]), zi);
+			__m256 d2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, e)));
+			__m256 inv = _mm256_div_ps(one, _mm256_sqrt_ps(d2));
+			__m256 s = _mm256_mul_ps(_mm256_loadu_ps(&list.m[j]), _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+			sumX = _mm256_fmadd_ps(dx, s, sumX);
+			sumY = _mm256_fmadd_ps(dy, s, sumY);
+			sumZ = _mm256_fmadd_ps(dz, s, sumZ);
+		}
+		ax = horizontalSum(sumX);
+		ay = horizontalSum(sumY);
+		az = horizontalSum(sumZ);
+	}
+	SIMD_AVX2_TARGET static float horizontalSum(__m256 v) {
+		__m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		return _mm_cvtss_f32(sum);
+	}
+#endif
+
+	//LSD radix sort of codes with order riding along, 6 passes of 11 bits cover all 63
+	void radixSort(unsigned int n) {
+		const unsigned int BITS = 11, BUCKETS = 1u << BITS;
+		codesScratch.resize(n);
+		orderScratch.resize(n);
+		vector<uint32_t> offsets(BUCKETS);
+		for (unsigned int shift = 0; shift < 3 * BH_MAX_DEPTH; shift += BITS) {
+			fill(offsets.begin(), offsets.end(), 0u);
+			for (unsigned int i = 0; i < n; i++) {
+				offsets[(codes[i] >> shift) & (BUCKETS - 1)]++;
+			}
+			uint32_t total = 0;
+			for (unsigned int b = 0; b < BUCKETS; b++) {
+				uint32_t c = offsets[b];
+				offsets[b] = total;
+				total += c;
+			}
+			for (unsigned int i = 0; i < n; i++) {
+				uint32_t dst = offsets[(codes[i] >> shift) & (BUCKETS - 1)]++;
+				codesScratch[dst] = codes[i];
+				orderScratch[dst] = order[i];
+			}
+			codes.swap(codesScratch);
+			order.swap(orderScratch);
+		}
+	}
+
+	//bodies [begin, end) share every morton digit above level, split them on the digit at level
+	uint32_t buildNode(uint32_t begin, uint32_t end, uint32_t level, float size) {
+		uint32_t index = (uint32_t)nodes.size();
+		nodes.push_back(Node());
+		float mass = 0.f, cx = 0.f, cy = 0.f, cz = 0.f;
+		uint32_t count = 0;
+		if (end - begin <= BH_LEAF_SIZE || level == BH_MAX_DEPTH) {
+			for (uint32_t k = begin; k < end; k++) {
+				mass += sm[k];
+				cx += sx[k] * sm[k];
+				cy += sy[k] * sm[k];
+				cz += sz[k] * sm[k];
+			}
+			count = end - begin;
+			leaves.push_back(index);
+		} else {
+			unsigned int shift = 3 * (BH_MAX_DEPTH - 1 - level);
+			uint32_t start = begin;
+			for (uint64_t octant = 0; octant < 8 && start < end; octant++) {
+				uint32_t stop = (uint32_t)(partition_point(codes.begin() + start, codes.begin() + end,
+					[shift, octant](uint64_t code) { return ((code >> shift) & 7) <= octant; }) - codes.begin());
+				if (stop > start) {
+					uint32_t child = buildNode(start, stop, level + 1, size * 0.5f);
+					const Node& c = nodes[child];
+					mass += c.mass;
+					cx += c.x * c.mass;
+					cy += c.y * c.mass;
+					cz += c.z * c.mass;
+				}
+				start = stop;
+			}
+		}
+		Node& node = nodes[index];
+		float inv = mass > 0.f ? 1.f / mass : 0.f;
+		node.x = cx * inv;
+		node.y = cy * inv;
+		node.z = cz * inv;
+		node.mass = mass;
+		node.size = size;
+		node.first = begin;
+		node.count = count;
+		node.next = (uint32_t)nodes.size();
+		return index;
+	}
+};
+
+#endif
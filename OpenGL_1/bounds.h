@@ -0,0 +1,25 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include "glm/glm.hpp"
+
+#include <cmath>
+using namespace std;
+
+//model space box and a sphere around it, worked out once at load so culling never looks at vertices again
+struct Bounds {
+	glm::vec3 min = glm::vec3(0.f);
+	glm::vec3 max = glm::vec3(0.f);
+	glm::vec3 center = glm::vec3(0.f); //of the sphere, the middle of the box
+	float radius = 0.f; //to the furthest vertex, a good bit tighter than half the box's diagonal
+
+	//world space sphere for a model matrix, the radius goes with the biggest axis scale so squashed models stay covered
+	glm::vec4 sphere(const glm::mat4& model) const {
+		glm::vec3 c = glm::vec3(model * glm::vec4(center, 1.f));
+		float scale2 = glm::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+			glm::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+		return glm::vec4(c, radius * sqrtf(scale2));
+	}
+};
+
+#endif
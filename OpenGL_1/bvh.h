@@ -0,0 +1,293 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "glm/glm.hpp"
+
+#include "frustum.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+const unsigned int BVH_LEAF_SIZE = 4;
+
+//bounding volume hierarchy over world space spheres, one per drawable, for culling, picking and proximity
+//nodes are stored depth first and every split is at the median, so a subtree over n items always takes
+//the same number of nodes in the same slots, which lets a degraded subtree be rebuilt in place
+//update() refits the boxes to wherever the items moved, then rebuilds just the subtrees whose boxes have
+//grown well past what they were built at, a full build only happens when the item count changes
+class Bvh {
+public:
+	struct Node {
+		glm::vec3 min;
+		unsigned int right; //second child, the first is always the next node, 0 for a leaf
+		glm::vec3 max;
+		unsigned int first; //items[first, first + count) are everything under this node
+		unsigned int count;
+	};
+	float degradeFactor = 2.f; //surface area a subtree can grow to, relative to its build, before it's rebuilt
+	//stats for the ui
+	unsigned int rebuiltSubtrees = 0; //last update()
+	unsigned int rebuiltItems = 0;
+	unsigned int nodesVisited = 0; //last query
+
+	//spheres are xyz center, w radius, index i in here is item i in every query
+	void update(const glm::vec4* spheres, unsigned int count) {
+		this->spheres.assign(spheres, spheres + count);
+		rebuiltSubtrees = rebuiltItems = 0;
+		if (count != items.size()) {
+			items.resize(count);
+			for (unsigned int i = 0; i < count; i++) {
+				items[i] = i;
+			}
+			nodes.resize(count == 0 ? 0 : nodeCount(count));
+			builtArea.resize(nodes.size());
+			if (count > 0) {
+				rebuild(0, 0, count);
+			}
+			return;
+		}
+		refit();
+		//topmost degraded subtrees first, everything under one that gets rebuilt is done with it
+		for (unsigned int i = 0; i < nodes.size();) {
+			if (area(nodes[i]) > builtArea[i] * degradeFactor) {
+				rebuild(i, nodes[i].first, nodes[i].count);
+				i += nodeCount(nodes[i].count);
+				continue;
+			}
+			i++;
+		}
+	}
+	unsigned int size() const {
+		return (unsigned int)items.size();
+	}
+	unsigned int nodeTotal() const {
+		return (unsigned int)nodes.size();
+	}
+
+	//appends every item at least partly inside, a node fully inside a plane stops testing against it
+	//and a node fully inside all six hands over its whole item range without looking any further
+	void queryFrustum(const Frustum& frustum, vector<unsigned int>& out) {
+		nodesVisited = 0;
+		if (nodes.empty()) {
+			return;
+		}
+		unsigned int stack[64][2]; //node, planes still to test as bits
+		unsigned int top = 0;
+		stack[top][0] = 0;
+		stack[top++][1] = 0x3F;
+		while (top > 0) {
+			top--;
+			const Node& node = nodes[stack[top][0]];
+			unsigned int planes = stack[top][1];
+			nodesVisited++;
+			bool outside = false;
+			for (int p = 0; p < 6 && !outside; p++) {
+				if (!(planes & (1u << p))) {
+					continue;
+				}
+				glm::vec3 n = glm::vec3(frustum.planes[p]);
+				//the box corners furthest along and against the normal
+				glm::vec3 ahead = glm::vec3(n.x >= 0.f ? node.max.x : node.min.x, n.y >= 0.f ? node.max.y : node.min.y, n.z >= 0.f ? node.max.z : node.min.z);
+				glm::vec3 behind = glm::vec3(n.x >= 0.f ? node.min.x : node.max.x, n.y >= 0.f ? node.min.y : node.max.y, n.z >= 0.f ? node.min.z : node.max.z);
+				if (glm::dot(n, ahead) + frustum.planes[p].w < 0.f) {
+					outside = true;
+				} else if (glm::dot(n, behind) + frustum.planes[p].w >= 0.f) {
+					planes &= ~(1u << p);
+				}
+			}
+			if (outside) {
+				continue;
+			}
+			if (planes == 0) {
+				out.insert(out.end(), items.begin() + node.first, items.begin() + node.first + node.count);
+				continue;
+			}
+			if (node.right == 0) {
+				for (unsigned int k = node.first; k < node.first + node.count; k++) {
+					if (frustum.sphereVisible(spheres[items[k]])) {
+						out.push_back(items[k]);
+					}
+				}
+				continue;
+			}
+			unsigned int index = (unsigned int)(&node - nodes.data());
+			stack[top][0] = node.right;
+			stack[top++][1] = planes;
+			stack[top][0] = index + 1;
+			stack[top++][1] = planes;
+		}
+	}
+	//nearest item the ray hits, -1 for none, direction has to be unit length, t comes back as the distance
+	int raycast(glm::vec3 origin, glm::vec3 direction, float& t, float maxDistance = 1e30f) {
+		nodesVisited = 0;
+		int hit = -1;
+		t = maxDistance;
+		if (nodes.empty()) {
+			return hit;
+		}
+		glm::vec3 inverse = glm::vec3(1.f) / direction;
+		unsigned int stack[64];
+		unsigned int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const Node& node = nodes[stack[--top]];
+			nodesVisited++;
+			if (slab(node, origin, inverse) >= t) {
+				continue;
+			}
+			if (node.right == 0) {
+				for (unsigned int k = node.first; k < node.first + node.count; k++) {
+					float d = raySphere(origin, direction, spheres[items[k]]);
+					if (d >= 0.f && d < t) {
+						t = d;
+						hit = (int)items[k];
+					}
+				}
+				continue;
+			}
+			//nearer child goes on top so it's tried first and can shrink t for the other one
+			unsigned int index = (unsigned int)(&node - nodes.data());
+			unsigned int a = index + 1, b = node.right;
+			if (slab(nodes[a], origin, inverse) > slab(nodes[b], origin, inverse)) {
+				swap(a, b);
+			}
+			stack[top++] = b;
+			stack[top++] = a;
+		}
+		return hit;
+	}
+	//appends every item whose sphere reaches into the one given
+	void queryRadius(glm::vec3 center, float radius, vector<unsigned int>& out) {
+		nodesVisited = 0;
+		if (nodes.empty()) {
+			return;
+		}
+		unsigned int stack[64];
+		unsigned int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const Node& node = nodes[stack[--top]];
+			nodesVisited++;
+			glm::vec3 d = center - glm::clamp(center, node.min, node.max);
+			if (glm::dot(d, d) > radius * radius) {
+				continue;
+			}
+			if (node.right == 0) {
+				for (unsigned int k = node.first; k < node.first + node.count; k++) {
+					const glm::vec4& s = spheres[items[k]];
+					glm::vec3 e = glm::vec3(s) - center;
+					if (glm::dot(e, e) <= (radius + s.w) * (radius + s.w)) {
+						out.push_back(items[k]);
+					}
+				}
+				continue;
+			}
+			unsigned int index = (unsigned int)(&node - nodes.data());
+			stack[top++] = node.right;
+			stack[top++] = index + 1;
+		}
+	}
+private:
+	vector<Node> nodes;
+	vector<float> builtArea; //per node, its surface area when it was last built
+	vector<unsigned int> items; //item indices, in leaf order
+	vector<glm::vec4> spheres;
+
+	//nodes a subtree over count items takes, the same every time for the same count
+	static unsigned int nodeCount(unsigned int count) {
+		if (count <= BVH_LEAF_SIZE) {
+			return 1;
+		}
+		return 1 + nodeCount(count / 2) + nodeCount(count - count / 2);
+	}
+	static float area(const Node& node) {
+		glm::vec3 e = node.max - node.min;
+		return e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+	void sphereBox(const glm::vec4& s, glm::vec3& min, glm::vec3& max) const {
+		min = glm::vec3(s) - s.w;
+		max = glm::vec3(s) + s.w;
+	}
+	void leafBox(Node& node) const {
+		sphereBox(spheres[items[node.first]], node.min, node.max);
+		for (unsigned int k = node.first + 1; k < node.first + node.count; k++) {
+			glm::vec3 min, max;
+			sphereBox(spheres[items[k]], min, max);
+			node.min = glm::min(node.min, min);
+			node.max = glm::max(node.max, max);
+		}
+	}
+	//depth first, so children always come after their parent and going backwards refits bottom up
+	void refit() {
+		for (unsigned int i = (unsigned int)nodes.size(); i-- > 0;) {
+			Node& node = nodes[i];
+			if (node.right == 0) {
+				leafBox(node);
+			} else {
+				node.min = glm::min(nodes[i + 1].min, nodes[node.right].min);
+				node.max = glm::max(nodes[i + 1].max, nodes[node.right].max);
+			}
+		}
+	}
+	//splits at the median along the longest axis of the centers, returns the node after the subtree
+	void rebuild(unsigned int index, unsigned int first, unsigned int count) {
+		rebuiltSubtrees++;
+		rebuiltItems += count;
+		build(index, first, count);
+	}
+	unsigned int build(unsigned int index, unsigned int first, unsigned int count) {
+		Node& node = nodes[index];
+		node.first = first;
+		node.count = count;
+		if (count <= BVH_LEAF_SIZE) {
+			node.right = 0;
+			leafBox(node);
+			builtArea[index] = area(node);
+			return index + 1;
+		}
+		glm::vec3 low = glm::vec3(spheres[items[first]]), high = low;
+		for (unsigned int k = first + 1; k < first + count; k++) {
+			low = glm::min(low, glm::vec3(spheres[items[k]]));
+			high = glm::max(high, glm::vec3(spheres[items[k]]));
+		}
+		glm::vec3 extent = high - low;
+		int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		unsigned int half = count / 2;
+		const vector<glm::vec4>& s = spheres;
+		nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+			[&s, axis](unsigned int a, unsigned int b) { return s[a][axis] < s[b][axis]; });
+		unsigned int right = build(index + 1, first, half);
+		unsigned int end = build(right, first + half, count - half);
+		node.right = right;
+		node.min = glm::min(nodes[index + 1].min, nodes[right].min);
+		node.max = glm::max(nodes[index + 1].max, nodes[right].max);
+		builtArea[index] = area(node);
+		return end;
+	}
+	//distance along the ray to where it enters the box, 1e30 for a miss
+	static float slab(const Node& node, glm::vec3 origin, glm::vec3 inverse) {
+		glm::vec3 t0 = (node.min - origin) * inverse;
+		glm::vec3 t1 = (node.max - origin) * inverse;
+		glm::vec3 first = glm::min(t0, t1), last = glm::max(t0, t1);
+		float enter = glm::max(glm::max(first.x, first.y), glm::max(first.z, 0.f));
+		float leave = glm::min(glm::min(last.x, last.y), last.z);
+		return enter <= leave ? enter : 1e30f;
+	}
+	//distance to the first surface hit, or where the ray leaves if it starts inside, -1 for a miss
+	static float raySphere(glm::vec3 origin, glm::vec3 direction, const glm::vec4& sphere) {
+		glm::vec3 oc = origin - glm::vec3(sphere);
+		float b = glm::dot(oc, direction);
+		float c = glm::dot(oc, oc) - sphere.w * sphere.w;
+		float disc = b * b - c;
+		if (disc < 0.f) {
+			return -1.f;
+		}
+		float root = sqrtf(disc);
+		float t = -b - root;
+		return t >= 0.f ? t : -b + root;
+	}
+};
+
+#endif
@@ -5,6 +5,8 @@
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 
+#include "frustum.h"
+
 #include <vector>
 
 //options for camera movement
@@ -63,6 +65,19 @@ public:
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    // unit vector from the camera through a point on the screen, x and y in window pixels from the top left, for picking
+    glm::vec3 GetRayDirection(float x, float y, float width, float height, const glm::mat4& projection) {
+        glm::vec4 clip = glm::vec4(2.0f * x / width - 1.0f, 1.0f - 2.0f * y / height, -1.0f, 1.0f);
+        glm::vec4 eye = glm::inverse(projection) * clip;
+        eye = glm::vec4(eye.x, eye.y, -1.0f, 0.0f);
+        return glm::normalize(glm::vec3(glm::inverse(GetViewMatrix()) * eye));
+    }
+
+    // what this camera can see through projection, for culling before anything gets drawn
+    Frustum GetFrustum(const glm::mat4& projection) {
+        return Frustum(projection * GetViewMatrix());
+    }
+
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime, bool shift) {
         float velocity = MovementSpeed * deltaTime;
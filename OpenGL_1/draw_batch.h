@@ -0,0 +1,239 @@
+#ifndef DRAW_BATCH_H
+#define DRAW_BATCH_H
+
+#include <glad/glad.h>
+
+#include "glm/glm.hpp"
+
+#include "shader.h"
+#include "material.h"
+#include "geometry_arena.h"
+#include "instance_buffer.h"
+#include "render_queue.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+//GL 4.3, or ARB_multi_draw_indirect with ARB_base_instance, looked up by hand so it works whatever version glad was made for
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+
+//laid out the way glMultiDrawElementsIndirect reads them
+struct DrawCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance; //which transform in the per-draw buffer this draw reads
+};
+
+//every regular mesh draw of the frame, collected and then sent in as few calls as the materials allow
+//transforms go into one per-draw buffer that instanced.vs reads as instance attributes, every draw is one
+//instance whose baseInstance picks its own transform out of it
+//every draw comes with a RenderKey, they're radix sorted once a frame and runs of draws with the same
+//program, material and outline id go out as a single glMultiDrawElementsIndirect each
+//textures can't change inside a call without bindless, so the material decides the group instead of
+//going into the per-draw data
+//anywhere without both (plain GL 3.3 included) the same groups go out as a loop of glDrawElementsBaseVertex, with the transform set
+//as constant attributes instead
+class DrawBatch {
+public:
+	bool indirect = true; //can be turned off to compare, only does anything where it's supported
+	//stats for the ui, both passes of the last frame
+	unsigned int draws = 0;
+	unsigned int buckets = 0;
+	unsigned int calls = 0;
+	unsigned int programChanges = 0;
+	unsigned int materialChanges = 0;
+
+	explicit DrawBatch(GLADloadproc load) {
+		glGenBuffers(1, &commandBuffer);
+		GLint major = 0, minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		//every draw finds its transform through baseInstance, which below 4.2 without ARB_base_instance
+		//has to be zero, so that's needed as much as the multi-draw itself
+		bool multiDraw = major > 4 || (major == 4 && minor >= 3);
+		bool baseInstance = major > 4 || (major == 4 && minor >= 2);
+		GLint extensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+		for (GLint i = 0; i < extensions && !(multiDraw && baseInstance); i++) {
+			const char* name = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+			if (name) {
+				multiDraw = multiDraw || strcmp(name, "GL_ARB_multi_draw_indirect") == 0;
+				baseInstance = baseInstance || strcmp(name, "GL_ARB_base_instance") == 0;
+			}
+		}
+		if (multiDraw && baseInstance) {
+			multiDrawElementsIndirect = (MultiDrawElementsIndirectProc)load("glMultiDrawElementsIndirect");
+		}
+	}
+	DrawBatch(const DrawBatch&) = delete;
+	DrawBatch& operator=(const DrawBatch&) = delete;
+
+	bool indirectSupported() const {
+		return multiDrawElementsIndirect != NULL;
+	}
+	//eye is where depth in the keys is measured from
+	void begin(const glm::vec3& eye) {
+		entries.clear();
+		transforms.clear();
+		sorted = false;
+		this->eye = eye;
+		draws = buckets = calls = programChanges = materialChanges = 0;
+		lastShader = NULL;
+		lastMaterial = NULL;
+	}
+	//what goes in the keys, distance to the transform's origin is plenty for ordering whole models
+	float distance(const glm::mat4& model) const {
+		return glm::length(glm::vec3(model[3]) - eye);
+	}
+	//one per model drawn, what add() takes as transform
+	unsigned int addTransform(const glm::mat4& model) {
+		transforms.push(model);
+		return transforms.count() - 1;
+	}
+	//shader has to take its transforms per instance like instanced.vs does, key from RenderKey
+	//decode has to outlive the frame, it's the owning model's
+	void add(uint64_t key, Shader& shader, const Material& material, const VertexDecode& decode, const GeometryRange& range,
+		unsigned int transform, int outlineId) {
+		Entry entry;
+		entry.key = key;
+		entry.shader = &shader;
+		entry.material = &material;
+		entry.decode = &decode;
+		entry.outlineId = outlineId;
+		entry.range = range;
+		entry.transform = transform;
+		entries.push_back(entry);
+	}
+	//draws everything queued for pass, the first call of a frame sorts and uploads for both passes
+	//transparent draws blend and leave depth alone, so they want to go last, after the skybox too
+	void flush(unsigned int pass) {
+		if (!sorted) {
+			prepare();
+		}
+		unsigned int first = 0;
+		while (first < order.size() && RenderKey::pass(order[first].key) < pass) {
+			first++;
+		}
+		unsigned int end = first;
+		while (end < order.size() && RenderKey::pass(order[end].key) == pass) {
+			end++;
+		}
+		if (first == end) {
+			return;
+		}
+		if (pass == RENDER_PASS_TRANSPARENT) {
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glDepthMask(GL_FALSE);
+		}
+		bool useIndirect = indirect && indirectSupported();
+		if (useIndirect) {
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		}
+		while (first < end) {
+			unsigned int last = first + 1;
+			while (last < end && sameBucket(entries[order[first].index], entries[order[last].index])) {
+				last++;
+			}
+			const Entry& bucket = entries[order[first].index];
+			programChanges += bucket.shader != lastShader;
+			materialChanges += bucket.material != lastMaterial;
+			lastShader = bucket.shader;
+			lastMaterial = bucket.material;
+			bucket.shader->use();
+			bucket.shader->setInt(bucket.shader->objectIdLoc, bucket.outlineId);
+			bucket.shader->setVertexDecode(bucket.decode->offset, bucket.decode->scale, bucket.decode->octNormals);
+			bucket.material->bind();
+			GeometryArena& arena = geometryArena(bucket.range.format);
+			if (useIndirect) {
+				arena.bindInstances(transforms);
+				multiDrawElementsIndirect(GL_TRIANGLES, bucket.range.indexType, (const void*)(first * sizeof(DrawCommand)), (GLsizei)(last - first), 0);
+				calls++;
+			} else {
+				arena.bindConstantInstance();
+				for (unsigned int i = first; i < last; i++) {
+					const Entry& entry = entries[order[i].index];
+					const InstanceData& data = transforms.instances[entry.transform];
+					for (GLuint c = 0; c < 4; c++) {
+						glVertexAttrib4fv(INSTANCE_ATTRIB_LOCATION + c, &data.model[c][0]);
+					}
+					for (GLuint c = 0; c < 3; c++) {
+						glVertexAttrib3fv(INSTANCE_ATTRIB_LOCATION + 4 + c, &data.normal[c][0]);
+					}
+					glDrawElementsBaseVertex(GL_TRIANGLES, entry.range.indexCount, entry.range.indexType, entry.range.indexOffset(), entry.range.baseVertex);
+					calls++;
+				}
+			}
+			buckets++;
+			first = last;
+		}
+		if (useIndirect) {
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		}
+		if (pass == RENDER_PASS_TRANSPARENT) {
+			glDepthMask(GL_TRUE);
+			glDisable(GL_BLEND);
+		}
+	}
+	void destroy() {
+		glDeleteBuffers(1, &commandBuffer);
+		transforms.destroy();
+	}
+private:
+	struct Entry {
+		uint64_t key;
+		Shader* shader;
+		const Material* material;
+		const VertexDecode* decode; //one per model, like materials, so it also keeps arenas apart
+		int outlineId;
+		GeometryRange range;
+		unsigned int transform;
+	};
+	vector<Entry> entries;
+	vector<SortItem> order, scratch; //entries sorted by key
+	bool sorted = false;
+	glm::vec3 eye = glm::vec3(0.f);
+	const Shader* lastShader = NULL; //what the previous group drew with, for counting changes
+	const Material* lastMaterial = NULL;
+	vector<DrawCommand> commands; //in sorted order
+	InstanceBuffer transforms; //per draw, instanced.vs reads them at baseInstance
+	GLuint commandBuffer = 0;
+	MultiDrawElementsIndirectProc multiDrawElementsIndirect = NULL;
+
+	void prepare() {
+		sorted = true;
+		draws = (unsigned int)entries.size();
+		order.resize(entries.size());
+		for (unsigned int i = 0; i < entries.size(); i++) {
+			order[i].key = entries[i].key;
+			order[i].index = i;
+		}
+		radixSort(order, scratch);
+		if (!indirect || !indirectSupported() || entries.empty()) {
+			return;
+		}
+		transforms.upload();
+		commands.resize(order.size());
+		for (unsigned int i = 0; i < order.size(); i++) {
+			const Entry& entry = entries[order[i].index];
+			commands[i] = { entry.range.indexCount, 1, entry.range.firstIndex, entry.range.baseVertex, entry.transform };
+		}
+		//orphaned like the instance buffers, last frame's calls may still be reading the old one
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawCommand), commands.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	static bool sameBucket(const Entry& a, const Entry& b) {
+		return a.shader == b.shader && a.material == b.material && a.decode == b.decode && a.outlineId == b.outlineId
+			&& a.range.indexType == b.range.indexType;
+	}
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef FRAME_DATA_H
+#define FRAME_DATA_H
+
+#include <glad/glad.h>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+#include "shader.h"
+
+#include <cstddef>
+
+//binding point the FrameData block of every shader gets hooked to
+const GLuint FRAME_DATA_BINDING = 0;
+//has to match NR_POINT_LIGHTS in the shaders
+const int NR_POINT_LIGHTS = 2;
+
+//CPU side mirror of the std140 PointLight struct in the shaders
+//every vec3 gets a float tucked into its 4th slot, same as std140 would place it
+struct PointLightStd140 {
+	glm::vec3 position;
+	float constant;
+	glm::vec3 ambient;
+	float linear;
+	glm::vec3 diffuse;
+	float quadratic;
+	glm::vec3 specular;
+	float pad;
+};
+
+//CPU side mirror of the std140 FrameData block, everything that's the same for every draw in a frame
+struct FrameData {
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec4 viewPos; //w unused, vec3 takes a full 16 bytes in std140
+	PointLightStd140 pointLights[NR_POINT_LIGHTS];
+};
+static_assert(sizeof(PointLightStd140) == 64, "PointLight must match the std140 array stride");
+static_assert(offsetof(FrameData, projection) == 64, "FrameData layout must match std140");
+static_assert(offsetof(FrameData, viewPos) == 128, "FrameData layout must match std140");
+static_assert(offsetof(FrameData, pointLights) == 144, "FrameData layout must match std140");
+
+//one uniform buffer holding FrameData, written once per frame and read by every program
+class FrameUniformBuffer {
+public:
+	FrameData data;
+
+	FrameUniformBuffer() {
+		glGenBuffers(1, &UBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, UBO);
+	}
+	FrameUniformBuffer(const FrameUniformBuffer&) = delete;
+	FrameUniformBuffer& operator=(const FrameUniformBuffer&) = delete;
+
+	//point the program's FrameData block at our binding point, programs without the block are left alone
+	void attach(Shader& shader) const {
+		shader.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+	}
+	//push the whole block in one go
+	void upload() const {
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	//has to happen while the context is still alive, so it's not left to the destructor
+	void destroy() {
+		glDeleteBuffers(1, &UBO);
+	}
+private:
+	unsigned int UBO;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "glm/glm.hpp"
+
+#include "bounds.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <vector>
+using namespace std;
+
+//the six planes of a projection * view matrix, normals point inwards and are unit length so plugging
+//a point into a plane gives its real distance, anything further out than its radius on any plane is gone
+class Frustum {
+public:
+	glm::vec4 planes[6]; //left, right, bottom, top, near, far
+
+	//sees everything, for when culling is off
+	Frustum() {
+		for (int i = 0; i < 6; i++) {
+			planes[i] = glm::vec4(0.f, 0.f, 0.f, 1.f);
+		}
+	}
+	//Gribb and Hartmann, each plane is the last row of the matrix plus or minus one of the others
+	explicit Frustum(const glm::mat4& m) {
+		glm::vec4 rows[4];
+		for (int r = 0; r < 4; r++) {
+			rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+		}
+		for (int i = 0; i < 6; i++) {
+			planes[i] = i % 2 == 0 ? rows[3] + rows[i / 2] : rows[3] - rows[i / 2];
+			planes[i] /= glm::length(glm::vec3(planes[i]));
+		}
+	}
+
+	//xyz center, w radius, in world space
+	bool sphereVisible(const glm::vec4& sphere) const {
+		for (int i = 0; i < 6; i++) {
+			if (glm::dot(glm::vec3(planes[i]), glm::vec3(sphere)) + planes[i].w < -sphere.w) {
+				return false;
+			}
+		}
+		return true;
+	}
+	bool visible(const Bounds& bounds, const glm::mat4& model) const {
+		return sphereVisible(bounds.sphere(model));
+	}
+	//instances as xyz position and w scale of a model with these bounds, the way PositionBuffer has them,
+	//appends the index of everything at least partly inside to visible, in order
+	//world space spheres go through as they are with a Bounds of center 0 and radius 1
+	void cull(const glm::vec4* instances, unsigned int count, const Bounds& bounds, vector<unsigned int>& visible, ThreadPool* pool = NULL) const {
+		const unsigned int CHUNK = 16384;
+		bool avx2 = cpuHasAVX2();
+		if (!pool || count <= CHUNK * 4) {
+			cullRange(instances, 0, count, bounds, avx2, visible);
+			return;
+		}
+		//every chunk into its own list so the order comes out the same as on one thread
+		//the scratch is the calling thread's, the workers get it by reference rather than finding their own
+		static thread_local vector<vector<unsigned int>> scratch;
+		vector<vector<unsigned int>>& parts = scratch;
+		unsigned int chunks = (count + CHUNK - 1) / CHUNK;
+		parts.resize(chunks);
+		pool->parallelFor(chunks, 1, [this, instances, count, &bounds, avx2, &parts](unsigned int begin, unsigned int end) {
+			for (unsigned int c = begin; c < end; c++) {
+				parts[c].clear();
+				cullRange(instances, c * CHUNK, c * CHUNK + CHUNK < count ? c * CHUNK + CHUNK : count, bounds, avx2, parts[c]);
+			}
+		});
+		for (unsigned int c = 0; c < chunks; c++) {
+			visible.insert(visible.end(), parts[c].begin(), parts[c].end());
+		}
+	}
+private:
+	void cullRange(const glm::vec4* instances, unsigned int begin, unsigned int end, const Bounds& bounds, bool avx2, vector<unsigned int>& visible) const {
+#ifdef SIMD_X86
+		if (avx2) {
+			begin = cullAVX2(instances, begin, end, bounds, visible);
+		}
+#endif
+		for (unsigned int i = begin; i < end; i++) {
+			glm::vec4 p = instances[i];
+			if (sphereVisible(glm::vec4(glm::vec3(p) + bounds.center * p.w, bounds.radius * p.w))) {
+				visible.push_back(i);
+			}
+		}
+	}
+#ifdef SIMD_X86
+	//8 instances against all six planes at once, returns where it stopped so the scalar loop can take the tail
+	SIMD_AVX2_TARGET unsigned int cullAVX2(const glm::vec4* instances, unsigned int begin, unsigned int end, const Bounds& bounds, vector<unsigned int>& visible) const {
+		const __m256 cx = _mm256_set1_ps(bounds.center.x), cy = _mm256_set1_ps(bounds.center.y), cz = _mm256_set1_ps(bounds.center.z);
+		const __m256 radius = _mm256_set1_ps(bounds.radius);
+		const __m256 zero = _mm256_setzero_ps();
+		unsigned int i = begin;
+		for (; i + 8 <= end; i += 8) {
+			//4x8 transpose, two instances per load to x, y, z and w of all eight
+			const float* in = &instances[i].x;
+			__m256 r0 = _mm256_loadu_ps(in), r1 = _mm256_loadu_ps(in + 8), r2 = _mm256_loadu_ps(in + 16), r3 = _mm256_loadu_ps(in + 24);
+			__m256 u0 = _mm256_permute2f128_ps(r0, r2, 0x20), u1 = _mm256_permute2f128_ps(r0, r2, 0x31);
+			__m256 u2 = _mm256_permute2f128_ps(r1, r3, 0x20), u3 = _mm256_permute2f128_ps(r1, r3, 0x31);
+			__m256 t0 = _mm256_unpacklo_ps(u0, u1), t1 = _mm256_unpackhi_ps(u0, u1);
+			__m256 t2 = _mm256_unpacklo_ps(u2, u3), t3 = _mm256_unpackhi_ps(u2, u3);
+			__m256 w = _mm256_shuffle_ps(t1, t3, 0xEE);
+			__m256 x = _mm256_fmadd_ps(w, cx, _mm256_shuffle_ps(t0, t2, 0x44));
+			__m256 y = _mm256_fmadd_ps(w, cy, _mm256_shuffle_ps(t0, t2, 0xEE));
+			__m256 z = _mm256_fmadd_ps(w, cz, _mm256_shuffle_ps(t1, t3, 0x44));
+			__m256 r = _mm256_mul_ps(w, radius);
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; p++) {
+				__m256 d = _mm256_fmadd_ps(_mm256_set1_ps(planes[p].x), x, _mm256_fmadd_ps(_mm256_set1_ps(planes[p].y), y,
+					_mm256_fmadd_ps(_mm256_set1_ps(planes[p].z), z, _mm256_add_ps(_mm256_set1_ps(planes[p].w), r))));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+			}
+			int bits = _mm256_movemask_ps(inside);
+			for (unsigned int b = 0; bits != 0 && b < 8; b++) {
+				if (bits & (1 << b)) {
+					visible.push_back(i + b);
+				}
+			}
+		}
+		return i;
+	}
+#endif
+};
+
+#endif
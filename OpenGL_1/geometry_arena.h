@@ -0,0 +1,197 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include "glm/glm.hpp"
+
+#include "gl_state.h"
+#include "instance_buffer.h"
+#include "vertex_format.h"
+
+#include <cstddef>
+using namespace std;
+
+//where one mesh landed in the arena, indices are relative to baseVertex so they go in exactly as imported
+struct GeometryRange {
+	VertexFormat format = VERTEX_FULL; //which arena it's in
+	GLint baseVertex = 0;
+	GLenum indexType = GL_UNSIGNED_INT; //GL_UNSIGNED_SHORT for meshes with few enough vertices
+	unsigned int firstIndex = 0; //counted in indexType's, which is what indirect commands want
+	unsigned int indexCount = 0;
+	//byte offset of the first index, what the draw calls take in place of a pointer
+	const void* indexOffset() const {
+		return (const void*)((size_t)firstIndex * (indexType == GL_UNSIGNED_SHORT ? 2 : 4));
+	}
+};
+
+//every mesh of every model in one vertex buffer and one index buffer behind a single VAO, so drawing any
+//of them is an offset into the same buffers and the VAO only gets bound once however many meshes there are
+//one arena per vertex format, the VAO is what knows how to read them
+//space is handed out from the end and never given back, models live as long as the program does
+//16 and 32 bit indices share the index buffer, each range aligned to its own size
+//when a buffer fills up it doubles and the old contents get copied over on the GPU
+class GeometryArena {
+public:
+	//stats for the ui
+	unsigned int meshCount = 0;
+	unsigned int growths = 0;
+
+	explicit GeometryArena(VertexFormat format) : format(format) {}
+	GeometryArena(const GeometryArena&) = delete;
+	GeometryArena& operator=(const GeometryArena&) = delete;
+
+	//GL thread only, the arrays are only read during the call, vertices are Vertex or CompactVertex to match the format
+	//and indices are uint16_t or unsigned int going by indexSize
+	GeometryRange add(const void* vertices, unsigned int vertexCount, const void* indices, unsigned int indexCount, unsigned int indexSize) {
+		if (VAO == 0) {
+			create();
+		}
+		size_t indexStart = (indexUsed + indexSize - 1) / indexSize * indexSize;
+		size_t indexBytes = (size_t)indexCount * indexSize;
+		if (vertexUsed + vertexCount > vertexCapacity || indexStart + indexBytes > indexCapacity) {
+			grow(vertexUsed + vertexCount, indexStart + indexBytes);
+		}
+		GeometryRange range;
+		range.format = format;
+		range.baseVertex = (GLint)vertexUsed;
+		range.indexType = indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		range.firstIndex = (unsigned int)(indexStart / indexSize);
+		range.indexCount = indexCount;
+		//through the copy target, binding GL_ELEMENT_ARRAY_BUFFER would change whichever VAO is bound
+		glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, vertexUsed * stride(), vertexCount * stride(), vertices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, indexStart, indexBytes, indices);
+		vertexUsed += vertexCount;
+		indexUsed = indexStart + indexBytes;
+		meshCount++;
+		return range;
+	}
+	void bind() {
+		glState().bindVertexArray(VAO);
+	}
+	//the one VAO's per-instance attributes get pointed at instances whenever a draw brings a different buffer
+	//Buffer is InstanceBuffer, PositionBuffer or OrbitBuffer, it knows how its attributes are laid out
+	template <class Buffer>
+	void bindInstances(const Buffer& instances) {
+		bind();
+		if (instanceVBO != instances.id()) {
+			Buffer::setupAttributes(instances.id());
+			instanceVBO = instances.id();
+		}
+	}
+	//for draws that set the per-instance attributes as constants, their arrays go off so GL reads those instead
+	void bindConstantInstance() {
+		bind();
+		if (instanceVBO != 0) {
+			for (GLuint i = 0; i < 7; i++) {
+				glDisableVertexAttribArray(INSTANCE_ATTRIB_LOCATION + i);
+			}
+			instanceVBO = 0;
+		}
+	}
+	size_t bytesUsed() const {
+		return vertexUsed * stride() + indexUsed;
+	}
+	size_t bytesReserved() const {
+		return vertexCapacity * stride() + indexCapacity;
+	}
+	void destroy() {
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		glState().invalidate();
+		VAO = VBO = EBO = instanceVBO = 0;
+		vertexUsed = indexUsed = vertexCapacity = indexCapacity = 0;
+		meshCount = 0;
+	}
+	size_t stride() const {
+		return format == VERTEX_COMPACT ? sizeof(CompactVertex) : sizeof(Vertex);
+	}
+private:
+	VertexFormat format;
+	GLuint VAO = 0, VBO = 0, EBO = 0;
+	GLuint instanceVBO = 0; //instance buffer the VAO's per-instance attributes currently read from
+	unsigned int vertexUsed = 0, vertexCapacity = 0;
+	size_t indexUsed = 0, indexCapacity = 0; //bytes, the two index sizes mix
+
+	void create() {
+		glGenVertexArrays(1, &VAO);
+		vertexCapacity = 1 << 16;
+		indexCapacity = 1 << 20;
+		VBO = newBuffer(vertexCapacity * stride(), 0, 0);
+		EBO = newBuffer(indexCapacity, 0, 0);
+		point();
+	}
+	void grow(unsigned int vertices, size_t indexBytes) {
+		growths++;
+		if (vertices > vertexCapacity) {
+			unsigned int capacity = vertexCapacity;
+			while (capacity < vertices) {
+				capacity *= 2;
+			}
+			GLuint bigger = newBuffer(capacity * stride(), VBO, vertexUsed * stride());
+			glDeleteBuffers(1, &VBO);
+			VBO = bigger;
+			vertexCapacity = capacity;
+		}
+		if (indexBytes > indexCapacity) {
+			size_t capacity = indexCapacity;
+			while (capacity < indexBytes) {
+				capacity *= 2;
+			}
+			GLuint bigger = newBuffer(capacity, EBO, indexUsed);
+			glDeleteBuffers(1, &EBO);
+			EBO = bigger;
+			indexCapacity = capacity;
+		}
+		point();
+	}
+	//an empty buffer of size bytes, starting with the first used bytes of old
+	static GLuint newBuffer(size_t size, GLuint old, size_t used) {
+		GLuint buffer;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+		if (old != 0 && used > 0) {
+			glBindBuffer(GL_COPY_READ_BUFFER, old);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+		}
+		return buffer;
+	}
+	//(re)attaches the buffers to the VAO, the instance attributes are left as they were
+	void point() {
+		bind();
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		if (format == VERTEX_COMPACT) {
+			//same locations, the shaders decode them, see vertex_format.h
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, texCoords));
+			return;
+		}
+		// vertex positions
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+		// vertex normals
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+		// vertex texture coords
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+	}
+};
+
+//one arena per vertex format
+inline GeometryArena& geometryArena(VertexFormat format = VERTEX_FULL) {
+	static GeometryArena full(VERTEX_FULL);
+	static GeometryArena compact(VERTEX_COMPACT);
+	return format == VERTEX_COMPACT ? compact : full;
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+//shadows the bits of GL binding state we touch every draw and skips the calls that wouldn't change anything
+//anything that binds behind its back (ImGui mostly) has to call invalidate() afterwards
+class GLState {
+public:
+	static const unsigned int MAX_UNITS = 16;
+
+	//counters for the current frame, shown in the control panel
+	unsigned int issued = 0;
+	unsigned int skipped = 0;
+
+	GLState() {
+		invalidate();
+	}
+	void useProgram(GLuint program) {
+		if (program == currentProgram) {
+			skipped++;
+			return;
+		}
+		glUseProgram(program);
+		currentProgram = program;
+		issued++;
+	}
+	void bindVertexArray(GLuint vao) {
+		if (vao == currentVAO) {
+			skipped++;
+			return;
+		}
+		glBindVertexArray(vao);
+		currentVAO = vao;
+		issued++;
+	}
+	//only GL_TEXTURE_2D and GL_TEXTURE_CUBE_MAP are tracked, nothing here uses anything else
+	void bindTexture(GLuint unit, GLenum target, GLuint texture) {
+		GLuint& bound = (target == GL_TEXTURE_CUBE_MAP) ? boundCube[unit] : bound2D[unit];
+		if (bound == texture) {
+			skipped++;
+			return;
+		}
+		if (unit != activeUnit) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+			activeUnit = unit;
+		}
+		glBindTexture(target, texture);
+		bound = texture;
+		issued++;
+	}
+	//forget everything, the next request for each binding goes through to GL again
+	void invalidate() {
+		currentProgram = INVALID;
+		currentVAO = INVALID;
+		activeUnit = INVALID;
+		for (unsigned int i = 0; i < MAX_UNITS; i++) {
+			bound2D[i] = INVALID;
+			boundCube[i] = INVALID;
+		}
+	}
+	void resetCounters() {
+		issued = 0;
+		skipped = 0;
+	}
+private:
+	//never a valid GL name, so it never matches a real request
+	static const GLuint INVALID = 0xFFFFFFFFu;
+	GLuint currentProgram;
+	GLuint currentVAO;
+	GLuint activeUnit;
+	GLuint bound2D[MAX_UNITS];
+	GLuint boundCube[MAX_UNITS];
+};
+
+//there's only ever one context, so there's only ever one tracker
+inline GLState& glState() {
+	static GLState state;
+	return state;
+}
+
+#endif
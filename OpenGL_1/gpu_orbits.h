@@ -0,0 +1,86 @@
+#ifndef GPU_ORBITS_H
+#define GPU_ORBITS_H
+
+#include <glad/glad.h>
+
+#include "glm/glm.hpp"
+
+#include "instance_buffer.h"
+#include "kepler.h"
+
+#include <cstddef>
+#include <vector>
+using namespace std;
+
+//the time uniform is a float, so the elements get moved up to a fresh epoch every so often to keep it small
+//10 minutes keeps the mean anomaly good to well under a millionth of a turn
+const double ORBIT_EPOCH_SECONDS = 600.0;
+
+//point locations 3-6 of the currently bound VAO at a buffer of OrbitInstance, and switch off the rest
+inline void setupOrbitAttributes(GLuint vbo) {
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	for (GLuint i = 0; i < 4; i++) {
+		GLuint location = INSTANCE_ATTRIB_LOCATION + i;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(OrbitInstance), (void*)(i * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+	}
+	for (GLuint i = 4; i < 7; i++) {
+		glDisableVertexAttribArray(INSTANCE_ATTRIB_LOCATION + i);
+	}
+}
+
+//orbital elements that sit on the GPU and stay put, orbit.vs solves Kepler's equation and spins each
+//body from a single time uniform, so once this is uploaded moving them costs the CPU nothing
+//the only uploads are when the set of orbits changes or the epoch has to move on
+class OrbitBuffer {
+public:
+	double epoch = 0.0;
+
+	OrbitBuffer() {
+		glGenBuffers(1, &ID);
+	}
+	OrbitBuffer(const OrbitBuffer&) = delete;
+	OrbitBuffer& operator=(const OrbitBuffer&) = delete;
+
+	//true when the buffer no longer matches the orbits or the time since the epoch is getting long
+	bool stale(const KeplerOrbits& orbits, double time) const {
+		return uploaded != orbits.count() || time - epoch > ORBIT_EPOCH_SECONDS || time < epoch;
+	}
+	void upload(const KeplerOrbits& orbits, double time) {
+		orbits.packInstances(time, scratch);
+		glBindBuffer(GL_ARRAY_BUFFER, ID);
+		glBufferData(GL_ARRAY_BUFFER, scratch.size() * sizeof(OrbitInstance), scratch.empty() ? NULL : scratch.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		epoch = time;
+		uploaded = orbits.count();
+		uploads++;
+		scratch.clear();
+	}
+	//what goes in orbit.vs's time uniform
+	float timeSinceEpoch(double time) const {
+		return (float)(time - epoch);
+	}
+	unsigned int count() const {
+		return uploaded;
+	}
+	unsigned int uploadCount() const {
+		return uploads;
+	}
+	GLuint id() const {
+		return ID;
+	}
+	void destroy() {
+		glDeleteBuffers(1, &ID);
+	}
+	static void setupAttributes(GLuint vbo) {
+		setupOrbitAttributes(vbo);
+	}
+private:
+	GLuint ID;
+	unsigned int uploaded = 0;
+	unsigned int uploads = 0;
+	vector<OrbitInstance> scratch;
+};
+
+#endif
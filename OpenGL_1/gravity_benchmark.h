@@ -0,0 +1,77 @@
+#ifndef GRAVITY_BENCHMARK_H
+#define GRAVITY_BENCHMARK_H
+
+#include "nbody.h"
+#include "thread_pool.h"
+
+#include "glm/glm.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+using namespace std;
+
+//bodies that get a direct-sum reference, past this the direct time is scaled up from the sample
+const unsigned int GRAVITY_BENCH_SAMPLE = 2048;
+
+//plummer sphere, clumped in the middle with a long tail, the kind of spread the tree has to cope with
+inline void fillPlummer(NBodySystem& bodies, unsigned int count, unsigned int seed) {
+	mt19937 rng(seed);
+	uniform_real_distribution<float> uniform(0.f, 1.f);
+	bodies.clear();
+	for (unsigned int i = 0; i < count; i++) {
+		float u = max(uniform(rng), 1e-6f);
+		float radius = min(1.f / sqrtf(powf(u, -2.f / 3.f) - 1.f), 50.f);
+		float z = 2.f * uniform(rng) - 1.f;
+		float phi = 2.f * 3.1415926f * uniform(rng);
+		float r = sqrtf(1.f - z * z);
+		bodies.addBody(radius * glm::vec3(r * cosf(phi), r * sinf(phi), z), glm::vec3(0.f), 1.f / count);
+	}
+}
+
+//--bench-gravity, direct sum vs Barnes-Hut at 1k to 1M bodies, prints a table and the force error of the tree
+inline void runGravityBenchmark(float openingAngle) {
+	ThreadPool pool;
+	NBodySystem bodies;
+	bodies.openingAngle = openingAngle;
+	printf("gravity benchmark, %u threads, %s direct sum, theta %.2f\n", pool.size() + 1, cpuHasAVX2() ? "AVX2" : "scalar", openingAngle);
+	printf("%10s %14s %12s %12s %10s %12s\n", "bodies", "direct ms", "tree ms", "build ms", "speedup", "rms error");
+	const unsigned int counts[] = { 1000, 10000, 100000, 1000000 };
+	for (unsigned int count : counts) {
+		fillPlummer(bodies, count, 1234);
+		unsigned int sample = min(count, GRAVITY_BENCH_SAMPLE);
+
+		//direct, on the first sample bodies only when there are too many to sum in full
+		bodies.barnesHut = false;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		bodies.computeAccelerations(&pool, sample);
+		double directMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() * count / sample;
+		vector<glm::vec3> reference(sample);
+		for (unsigned int i = 0; i < sample; i++) {
+			reference[i] = bodies.acceleration(i);
+		}
+
+		bodies.barnesHut = true;
+		bodies.computeAccelerations(&pool); //warm up the tree's buffers
+		start = chrono::steady_clock::now();
+		bodies.computeAccelerations(&pool);
+		double treeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+		double error = 0.0;
+		for (unsigned int i = 0; i < sample; i++) {
+			float length = glm::length(reference[i]);
+			if (length > 0.f) {
+				float relative = glm::length(bodies.acceleration(i) - reference[i]) / length;
+				error += relative * relative;
+			}
+		}
+		error = sqrt(error / sample);
+		printf("%10u %13.1f%s %12.1f %12.1f %9.1fx %12.2e\n", count, directMs, sample < count ? "*" : " ", treeMs,
+			bodies.tree().buildMilliseconds, directMs / treeMs, error);
+	}
+	printf("* scaled up from %u bodies\n", GRAVITY_BENCH_SAMPLE);
+}
+
+#endif
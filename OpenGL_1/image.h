@@ -0,0 +1,116 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <glad/glad.h>
+
+#include "stb_image.h"
+#include "gl_state.h"
+#include "hash.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+using namespace std;
+
+//decoded pixels straight out of stb_image, freed automatically
+//decoding is plain CPU work and safe on any thread, uploading needs the GL thread
+struct Image {
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	unique_ptr<unsigned char, void(*)(void*)> pixels{ nullptr, stbi_image_free };
+
+	bool valid() const {
+		return pixels != nullptr;
+	}
+};
+
+//what a texture file holds, worked out from the file bytes and the image header without decoding
+struct TextureInfo {
+	uint64_t contentHash = 0;
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+};
+
+inline Image decodeImage(const string& filename) {
+	Image image;
+	image.pixels.reset(stbi_load(filename.c_str(), &image.width, &image.height, &image.channels, 0));
+	return image;
+}
+inline Image decodeImage(const vector<unsigned char>& bytes) {
+	Image image;
+	if (!bytes.empty()) {
+		image.pixels.reset(stbi_load_from_memory(bytes.data(), (int)bytes.size(), &image.width, &image.height, &image.channels, 0));
+	}
+	return image;
+}
+inline bool readFileBytes(const string& filename, vector<unsigned char>& bytes) {
+	ifstream file(filename, ios::binary | ios::ate);
+	if (!file) {
+		return false;
+	}
+	bytes.resize((size_t)file.tellg());
+	file.seekg(0);
+	file.read((char*)bytes.data(), bytes.size());
+	return (bool)file;
+}
+//hash of the file plus the size from its header, all zero if the file couldn't be read
+inline TextureInfo inspectImage(const vector<unsigned char>& bytes) {
+	TextureInfo info;
+	if (bytes.empty()) {
+		return info;
+	}
+	info.contentHash = fnv1a(bytes.data(), bytes.size());
+	stbi_info_from_memory(bytes.data(), (int)bytes.size(), &info.width, &info.height, &info.channels);
+	return info;
+}
+//GPU footprint of a texture with its full mip chain, one byte per channel
+inline size_t textureBytes(int width, int height, int channels) {
+	size_t bytes = 0;
+	if (width <= 0 || height <= 0) {
+		return 0;
+	}
+	for (;;) {
+		bytes += (size_t)width * height * channels;
+		if (width == 1 && height == 1) {
+			return bytes;
+		}
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+}
+
+inline GLenum imageFormat(int channels) {
+	if (channels == 1)
+		return GL_RED;
+	if (channels == 3)
+		return GL_RGB;
+	return GL_RGBA;
+}
+
+//same texture setup TextureFromFile always did, repeat wrapping and trilinear filtering
+inline unsigned int uploadTexture2D(const Image& image, const string& path) {
+	unsigned int textureID;
+	glGenTextures(1, &textureID);
+	if (image.valid()) {
+		GLenum format = imageFormat(image.channels);
+		glState().bindTexture(0, GL_TEXTURE_2D, textureID);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	} else {
+		std::cout << "Texture failed to load at path: " << path << std::endl;
+	}
+	return textureID;
+}
+
+#endif
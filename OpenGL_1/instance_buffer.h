@@ -0,0 +1,147 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <vector>
+using namespace std;
+
+//first attribute location the per-instance data takes, 0-2 are the regular vertex attributes
+const GLuint INSTANCE_ATTRIB_LOCATION = 3;
+
+//what instanced.vs reads per instance, normal matrix is worked out on the CPU same as drawModel does
+struct InstanceData {
+	glm::mat4 model;
+	glm::mat3 normal;
+};
+
+//point locations 3-6 (model columns) and 7-9 (normal matrix columns) of the currently bound VAO at vbo
+inline void setupInstanceAttributes(GLuint vbo) {
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	for (GLuint i = 0; i < 4; i++) {
+		GLuint location = INSTANCE_ATTRIB_LOCATION + i;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+			(void*)(offsetof(InstanceData, model) + i * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+	}
+	for (GLuint i = 0; i < 3; i++) {
+		GLuint location = INSTANCE_ATTRIB_LOCATION + 4 + i;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+			(void*)(offsetof(InstanceData, normal) + i * sizeof(glm::vec3)));
+		glVertexAttribDivisor(location, 1);
+	}
+}
+//point location 3 of the currently bound VAO at vbo as one vec4 per instance, and switch off the
+//matrix locations another buffer may have left on
+inline void setupPositionAttributes(GLuint vbo) {
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glEnableVertexAttribArray(INSTANCE_ATTRIB_LOCATION);
+	glVertexAttribPointer(INSTANCE_ATTRIB_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+	glVertexAttribDivisor(INSTANCE_ATTRIB_LOCATION, 1);
+	for (GLuint i = 1; i < 7; i++) {
+		glDisableVertexAttribArray(INSTANCE_ATTRIB_LOCATION + i);
+	}
+}
+
+//per-instance transforms, filled on the CPU and sent over in one upload
+class InstanceBuffer {
+public:
+	vector<InstanceData> instances;
+
+	InstanceBuffer() {
+		glGenBuffers(1, &ID);
+	}
+	InstanceBuffer(const InstanceBuffer&) = delete;
+	InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+	void clear() {
+		instances.clear();
+	}
+	void push(const glm::mat4& model) {
+		instances.push_back(InstanceData());
+		set(count() - 1, model);
+	}
+	//resize then set() lets jobs fill disjoint ranges side by side
+	void resize(unsigned int count) {
+		instances.resize(count);
+	}
+	void set(unsigned int i, const glm::mat4& model) {
+		instances[i].model = model;
+		instances[i].normal = glm::mat3(glm::transpose(glm::inverse(model)));
+	}
+	//orphans the old storage so we never wait on a draw that's still reading it
+	void upload() {
+		glBindBuffer(GL_ARRAY_BUFFER, ID);
+		if (instances.size() > capacity) {
+			capacity = instances.size();
+		}
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+		if (!instances.empty()) {
+			glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(InstanceData), instances.data());
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	unsigned int count() const {
+		return (unsigned int)instances.size();
+	}
+	GLuint id() const {
+		return ID;
+	}
+	void destroy() {
+		glDeleteBuffers(1, &ID);
+	}
+	static void setupAttributes(GLuint vbo) {
+		setupInstanceAttributes(vbo);
+	}
+private:
+	GLuint ID;
+	size_t capacity = 0;
+};
+
+//just a position and a size per instance, for swarms of identical bodies that don't turn,
+//16 bytes each instead of the 100 a full transform takes, positions.vs reads it
+class PositionBuffer {
+public:
+	PositionBuffer() {
+		glGenBuffers(1, &ID);
+	}
+	PositionBuffer(const PositionBuffer&) = delete;
+	PositionBuffer& operator=(const PositionBuffer&) = delete;
+
+	//xyz position, w size, orphans like InstanceBuffer::upload
+	void upload(const glm::vec4* positions, unsigned int count) {
+		glBindBuffer(GL_ARRAY_BUFFER, ID);
+		if (count > capacity) {
+			capacity = count;
+		}
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+		if (count > 0) {
+			glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::vec4), positions);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		instanceCount = count;
+	}
+	unsigned int count() const {
+		return instanceCount;
+	}
+	GLuint id() const {
+		return ID;
+	}
+	void destroy() {
+		glDeleteBuffers(1, &ID);
+	}
+	static void setupAttributes(GLuint vbo) {
+		setupPositionAttributes(vbo);
+	}
+private:
+	GLuint ID;
+	unsigned int capacity = 0;
+	unsigned int instanceCount = 0;
+};
+
+#endif
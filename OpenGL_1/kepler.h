@@ -0,0 +1,224 @@
+#ifndef KEPLER_H
+#define KEPLER_H
+
+#include "glm/glm.hpp"
+
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+//orbits are padded to a multiple of this, the padding has zero size and sits at the focus
+const unsigned int KEPLER_LANES = 8;
+
+//classical elements, angles in radians, the reference plane is the scene's xz plane
+struct KeplerElements {
+	float semiMajorAxis;
+	float eccentricity; //ellipses only, 0 <= e < 1
+	float inclination;
+	float ascendingNode;
+	float argumentOfPeriapsis;
+	float meanAnomaly; //at time 0
+};
+
+//one orbit as orbit.vs reads it, four vec4s straight into an OrbitBuffer
+struct OrbitInstance {
+	glm::vec4 periapsis; //unit vector to periapsis, w semi-major axis
+	glm::vec4 ahead; //unit vector 90 degrees on from it, w semi-minor axis
+	glm::vec4 motion; //eccentricity, mean motion, mean anomaly at the epoch, size
+	glm::vec4 spin; //axis scaled by the rate in radians per second, w angle at the epoch
+};
+
+//bodies on fixed two-body orbits, nothing pulls on them but their focus, so any time can be
+//evaluated straight from the elements: mean anomaly from the clock, Kepler's equation by Newton, then
+//the position in the orbit plane rotated out by the two axes worked out once in add()
+//everything is SoA, eight orbits per AVX2 lane set, and the result is a vec4 per body for PositionBuffer
+class KeplerOrbits {
+public:
+	//fixed so every lane does the same work, 4 gets float precision for e up to about 0.8
+	unsigned int newtonIterations = 4;
+	bool useSIMD = true;
+	double propagateMilliseconds = 0.0;
+	//xyz relative to the focus, w is the size the body is drawn at
+	vector<glm::vec4> positions;
+
+	//mu is G times the mass at the focus, spin is the axis scaled by radians per second, only orbit.vs turns them
+	unsigned int add(const KeplerElements& elements, float mu, float size, glm::vec3 spin = glm::vec3(0.f), float spinAngle = 0.f) {
+		unsigned int i = n++;
+		grow();
+		float ci = cosf(elements.inclination), si = sinf(elements.inclination);
+		float cn = cosf(elements.ascendingNode), sn = sinf(elements.ascendingNode);
+		float cw = cosf(elements.argumentOfPeriapsis), sw = sinf(elements.argumentOfPeriapsis);
+		//periapsis and 90 degrees ahead of it, in the usual z-up frame
+		glm::vec3 p = glm::vec3(cn * cw - sn * sw * ci, sn * cw + cn * sw * ci, sw * si);
+		glm::vec3 q = glm::vec3(-cn * sw - sn * cw * ci, -sn * sw + cn * cw * ci, cw * si);
+		//z-up to our y-up, (x, y, z) -> (x, -z, y) keeps prograde orbits turning the same way as the planets
+		px[i] = p.x;
+		py[i] = -p.z;
+		pz[i] = p.y;
+		qx[i] = q.x;
+		qy[i] = -q.z;
+		qz[i] = q.y;
+		float a = elements.semiMajorAxis, e = elements.eccentricity;
+		semiMajor[i] = a;
+		semiMinor[i] = a * sqrtf(1.f - e * e);
+		eccentricity[i] = e;
+		meanMotion[i] = sqrt((double)mu / ((double)a * a * a));
+		meanAnomaly0[i] = elements.meanAnomaly;
+		sizes[i] = size;
+		spinX[i] = spin.x;
+		spinY[i] = spin.y;
+		spinZ[i] = spin.z;
+		spinAngle0[i] = spinAngle;
+		return i;
+	}
+	void truncate(unsigned int first) {
+		if (first >= n) {
+			return;
+		}
+		n = first;
+		grow();
+	}
+	void clear() {
+		truncate(0);
+	}
+	unsigned int count() const {
+		return n;
+	}
+	glm::vec3 position(unsigned int i) const {
+		return glm::vec3(positions[i]);
+	}
+
+	//every orbit at time seconds, the mean anomaly is worked out and wrapped in double so a clock
+	//that's been running for days still lands on the right spot
+	void propagate(double time, ThreadPool* pool) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		bool avx2 = useSIMD && cpuHasAVX2();
+		unsigned int blocks = (unsigned int)semiMajor.size() / KEPLER_LANES;
+		auto range = [this, time, avx2](unsigned int begin, unsigned int end) {
+			for (unsigned int block = begin; block < end; block++) {
+#ifdef SIMD_X86
+				if (avx2) {
+					solveAVX2(block * KEPLER_LANES, time);
+					continue;
+				}
+#endif
+				solveScalar(block * KEPLER_LANES, time);
+			}
+		};
+		if (pool && n > 4096) {
+			pool->parallelFor(blocks, 128, range);
+		} else {
+			range(0, blocks);
+		}
+		propagateMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+	//the elements as of epoch for the GPU, which only ever sees a short float time since then
+	void packInstances(double epoch, vector<OrbitInstance>& out) const {
+		const double TWO_PI = 6.283185307179586;
+		out.resize(n);
+		for (unsigned int i = 0; i < n; i++) {
+			OrbitInstance& o = out[i];
+			o.periapsis = glm::vec4(px[i], py[i], pz[i], semiMajor[i]);
+			o.ahead = glm::vec4(qx[i], qy[i], qz[i], semiMinor[i]);
+			o.motion = glm::vec4(eccentricity[i], (float)meanMotion[i], meanAnomaly(meanMotion[i], meanAnomaly0[i], epoch), sizes[i]);
+			double rate = sqrt((double)spinX[i] * spinX[i] + (double)spinY[i] * spinY[i] + (double)spinZ[i] * spinZ[i]);
+			double angle = spinAngle0[i] + rate * epoch;
+			o.spin = glm::vec4(spinX[i], spinY[i], spinZ[i], (float)(angle - TWO_PI * floor(angle / TWO_PI)));
+		}
+	}
+private:
+	unsigned int n = 0;
+	vector<double> meanMotion, meanAnomaly0;
+	vector<float> semiMajor, semiMinor, eccentricity;
+	vector<float> px, py, pz; //unit vector to periapsis
+	vector<float> qx, qy, qz; //unit vector 90 degrees ahead of it
+	vector<float> sizes;
+	vector<float> spinX, spinY, spinZ, spinAngle0;
+
+	//keeps every array at n rounded up to the lane count, the padding is a zero sized orbit of zero radius
+	void grow() {
+		size_t padded = (n + KEPLER_LANES - 1) / KEPLER_LANES * KEPLER_LANES;
+		vector<float>* arrays[] = { &semiMajor, &semiMinor, &eccentricity, &px, &py, &pz, &qx, &qy, &qz, &sizes, &spinX, &spinY, &spinZ, &spinAngle0 };
+		for (vector<float>* array : arrays) {
+			array->resize(padded, 0.f);
+			for (size_t i = n; i < padded; i++) {
+				(*array)[i] = 0.f;
+			}
+		}
+		meanMotion.resize(padded, 0.0);
+		meanAnomaly0.resize(padded, 0.0);
+		for (size_t i = n; i < padded; i++) {
+			meanMotion[i] = meanAnomaly0[i] = 0.0;
+		}
+		positions.resize(padded, glm::vec4(0.f));
+	}
+
+	//mean anomaly in [-pi, pi]
+	static float meanAnomaly(double meanMotion, double meanAnomaly0, double time) {
+		const double TWO_PI = 6.283185307179586;
+		double m = meanAnomaly0 + meanMotion * time;
+		return (float)(m - TWO_PI * floor(m / TWO_PI + 0.5));
+	}
+	void solveScalar(unsigned int first, double time) {
+		for (unsigned int i = first; i < first + KEPLER_LANES; i++) {
+			float m = meanAnomaly(meanMotion[i], meanAnomaly0[i], time);
+			float e = eccentricity[i];
+			float E = m + e * sinf(m);
+			for (unsigned int k = 0; k < newtonIterations; k++) {
+				E -= (E - e * sinf(E) - m) / (1.f - e * cosf(E));
+			}
+			float x = semiMajor[i] * (cosf(E) - e);
+			float y = semiMinor[i] * sinf(E);
+			positions[i] = glm::vec4(px[i] * x + qx[i] * y, py[i] * x + qy[i] * y, pz[i] * x + qz[i] * y, sizes[i]);
+		}
+	}
+#ifdef SIMD_X86
+	SIMD_AVX2_TARGET void solveAVX2(unsigned int first, double time) {
+		//mean anomaly four doubles at a time, then down to floats for the rest
+		const __m256d t = _mm256_set1_pd(time);
+		const __m256d twoPi = _mm256_set1_pd(6.283185307179586);
+		const __m256d invTwoPi = _mm256_set1_pd(0.15915494309189535);
+		__m256d lo = _mm256_fmadd_pd(_mm256_loadu_pd(&meanMotion[first]), t, _mm256_loadu_pd(&meanAnomaly0[first]));
+		__m256d hi = _mm256_fmadd_pd(_mm256_loadu_pd(&meanMotion[first + 4]), t, _mm256_loadu_pd(&meanAnomaly0[first + 4]));
+		lo = _mm256_fnmadd_pd(_mm256_round_pd(_mm256_mul_pd(lo, invTwoPi), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC), twoPi, lo);
+		hi = _mm256_fnmadd_pd(_mm256_round_pd(_mm256_mul_pd(hi, invTwoPi), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC), twoPi, hi);
+		__m256 m = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1);
+
+		const __m256 one = _mm256_set1_ps(1.f);
+		__m256 e = _mm256_loadu_ps(&eccentricity[first]);
+		__m256 s, c;
+		sincos256(m, s, c);
+		__m256 E = _mm256_fmadd_ps(e, s, m);
+		for (unsigned int k = 0; k < newtonIterations; k++) {
+			sincos256(E, s, c);
+			__m256 f = _mm256_fnmadd_ps(e, s, _mm256_sub_ps(E, m));
+			__m256 slope = _mm256_fnmadd_ps(e, c, one);
+			E = _mm256_sub_ps(E, _mm256_div_ps(f, slope));
+		}
+		sincos256(E, s, c);
+		__m256 x = _mm256_mul_ps(_mm256_loadu_ps(&semiMajor[first]), _mm256_sub_ps(c, e));
+		__m256 y = _mm256_mul_ps(_mm256_loadu_ps(&semiMinor[first]), s);
+		__m256 wx = _mm256_fmadd_ps(_mm256_loadu_ps(&px[first]), x, _mm256_mul_ps(_mm256_loadu_ps(&qx[first]), y));
+		__m256 wy = _mm256_fmadd_ps(_mm256_loadu_ps(&py[first]), x, _mm256_mul_ps(_mm256_loadu_ps(&qy[first]), y));
+		__m256 wz = _mm256_fmadd_ps(_mm256_loadu_ps(&pz[first]), x, _mm256_mul_ps(_mm256_loadu_ps(&qz[first]), y));
+		__m256 ww = _mm256_loadu_ps(&sizes[first]);
+
+		//8x4 transpose into xyzw per body
+		__m256 t0 = _mm256_unpacklo_ps(wx, wy), t1 = _mm256_unpackhi_ps(wx, wy);
+		__m256 t2 = _mm256_unpacklo_ps(wz, ww), t3 = _mm256_unpackhi_ps(wz, ww);
+		__m256 b0 = _mm256_shuffle_ps(t0, t2, 0x44), b1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+		__m256 b2 = _mm256_shuffle_ps(t1, t3, 0x44), b3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+		float* out = &positions[first].x;
+		_mm256_storeu_ps(out, _mm256_permute2f128_ps(b0, b1, 0x20));
+		_mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(b2, b3, 0x20));
+		_mm256_storeu_ps(out + 16, _mm256_permute2f128_ps(b0, b1, 0x31));
+		_mm256_storeu_ps(out + 24, _mm256_permute2f128_ps(b2, b3, 0x31));
+	}
+#endif
+};
+
+#endif
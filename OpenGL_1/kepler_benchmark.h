@@ -0,0 +1,72 @@
+#ifndef KEPLER_BENCHMARK_H
+#define KEPLER_BENCHMARK_H
+
+#include "kepler.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+using namespace std;
+
+//best of a few runs, the first one also pays for faulting the output in
+inline double timePropagate(KeplerOrbits& orbits, double time, ThreadPool* pool) {
+	double best = 1e30;
+	for (int run = 0; run < 5; run++) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		orbits.propagate(time + run, pool);
+		best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+//--bench-kepler, a million random orbits, scalar vs AVX2 on one core and AVX2 on every core
+//the error is against the same orbits solved to convergence, in units of the semi-major axis
+inline void runKeplerBenchmark() {
+	const unsigned int COUNT = 1000000;
+	const double TIME = 86400.0 * 3.0; //a few days in, where float time would have fallen apart
+	ThreadPool pool;
+	KeplerOrbits orbits;
+	mt19937 rng(42);
+	uniform_real_distribution<float> uniform(0.f, 1.f);
+	for (unsigned int i = 0; i < COUNT; i++) {
+		KeplerElements elements;
+		elements.semiMajorAxis = 1.f + 20.f * uniform(rng);
+		elements.eccentricity = 0.7f * uniform(rng);
+		elements.inclination = 3.1415926f * uniform(rng);
+		elements.ascendingNode = 6.2831853f * uniform(rng);
+		elements.argumentOfPeriapsis = 6.2831853f * uniform(rng);
+		elements.meanAnomaly = 6.2831853f * uniform(rng);
+		orbits.add(elements, 1.f, 0.01f);
+	}
+
+	orbits.useSIMD = false;
+	orbits.newtonIterations = 30;
+	orbits.propagate(TIME, &pool);
+	vector<glm::vec4> reference(orbits.positions.begin(), orbits.positions.begin() + COUNT);
+	orbits.newtonIterations = 4;
+
+	printf("kepler benchmark, %u orbits, e up to 0.7, %u Newton iterations\n", COUNT, orbits.newtonIterations);
+	printf("%-18s %10s %18s %12s\n", "", "ms", "bodies/s/core", "max error");
+	struct Mode { const char* name; bool simd; bool threaded; };
+	Mode modes[] = { { "scalar, 1 core", false, false }, { "AVX2, 1 core", true, false }, { "AVX2, all cores", true, true } };
+	for (const Mode& mode : modes) {
+		if (mode.simd && !cpuHasAVX2()) {
+			printf("%-18s no AVX2 on this CPU\n", mode.name);
+			continue;
+		}
+		orbits.useSIMD = mode.simd;
+		unsigned int cores = mode.threaded ? pool.size() + 1 : 1;
+		double seconds = timePropagate(orbits, TIME - 4.0, mode.threaded ? &pool : NULL);
+		orbits.propagate(TIME, NULL);
+		double error = 0.0;
+		for (unsigned int i = 0; i < COUNT; i++) {
+			error = max(error, (double)(glm::length(glm::vec3(orbits.positions[i]) - glm::vec3(reference[i])) / glm::length(glm::vec3(reference[i]))));
+		}
+		printf("%-18s %10.2f %18.3g %12.2e\n", mode.name, seconds * 1000.0, COUNT / seconds / cores, error);
+	}
+}
+
+#endif
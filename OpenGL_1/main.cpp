@@ -8,24 +8,94 @@
 #include "stb_image.h"
 #include "camera.h"
 #include "model.h"
+#include "frame_data.h"
+#include "bvh.h"
+#include "material.h"
+#include "gl_state.h"
+#include "scene_graph.h"
+#include "instance_buffer.h"
+#include "asset_loader.h"
+#include "nbody.h"
+#include "gravity_benchmark.h"
+#include "kepler.h"
+#include "kepler_benchmark.h"
+#include "gpu_orbits.h"
+#include "sim_clock.h"
+#include "triple_buffer.h"
+#include "outline_pass.h"
+#include "draw_batch.h"
 
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+
+//what the UI wants from the simulation, handed to the simulation thread once a frame
+struct SimSettings {
+	float timeScale = 1.f;
+	bool paused = false;
+	bool stopEarth = false;
+	bool mergeStars = false;
+	int asteroidCount = 0;
+	bool barnesHut = false;
+	float openingAngle = 0.5f;
+	unsigned int resets = 0; //goes up by one for every press of reset
+};
+
+//body positions as of the end of one batch of steps and as of its start, so the render thread can draw anywhere in between
+struct BodySnapshot {
+	uint64_t firstTick = 0; //tick before the batch
+	uint64_t tick = 0; //tick after it
+	double stepSeconds = 0.0;
+	double span = 0.0; //real seconds the batch stands for
+	std::chrono::steady_clock::time_point published;
+	vector<glm::vec3> previous;
+	vector<glm::vec3> current;
+	//stats for the ui
+	double stepMilliseconds = 0.0;
+	unsigned int treeNodes = 0;
+	double treeBuildMilliseconds = 0.0;
+
+	glm::vec3 position(unsigned int i, float alpha) const {
+		return glm::mix(previous[i], current[i], alpha);
+	}
+	double time(float alpha) const {
+		return (firstTick + alpha * (double)(tick - firstTick)) * stepSeconds;
+	}
+};
+
+//everything the simulation thread owns, the render thread only ever touches the two buffers
+struct Simulation {
+	SimClock clock;
+	NBodySystem bodies;
+	TripleBuffer<SimSettings> settings; //render -> simulation
+	TripleBuffer<BodySnapshot> snapshots; //simulation -> render
+	std::atomic<bool> running{ true };
+};
 
 void processInput(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-unsigned int loadCubemap(vector<std::string> faces);
-void drawStar(float currentFrame, Shader& objShader, Model& objModel, glm::vec3& pos, float scale, float max_scale, bool outline);
-void drawDevourer(float currentFrame, Shader &objShader, Model &objModel, bool spin, bool outline);
-void movePlanet(glm::mat4 &model, float currentFrame, float orbitSpeed, float orbitDistance, float spinSpeed);
-void moveMoon(glm::mat4& model, float currentFrame, float orbitSpeed, float orbitDistance, float spinSpeed);
-void moveShip(glm::mat4& model, float currentFrame, float orbitSpeed, float orbitDistance, float tilt);
-void drawModel(glm::mat4& model, Shader& objShader, Model& objModel, bool outline);
+void drawDevourer(double simTime, Shader &objShader, Model &objModel, InstanceBuffer &instances, bool spin, int outlineId);
+void drawModel(DrawBatch& batch, glm::mat4 model, Shader& objShader, Model& objModel, int outlineId);
+bool inView(const Model& objModel, const glm::mat4& model);
+void drawAsteroids(const BodySnapshot& snapshot, float alpha, const vector<unsigned int>& visible, ThreadPool& jobs, Shader& objShader, Model& objModel, InstanceBuffer& instances);
+float starsMass();
+void setupBodies(NBodySystem& bodies, int asteroids);
+void setAsteroidCount(NBodySystem& bodies, int count);
+void mergeStars(NBodySystem& bodies, float dt);
+void simulationLoop(Simulation& simulation, ThreadPool& pool);
+void copyPositions(const NBodySystem& bodies, vector<glm::vec3>& positions);
+void setOuterBeltCount(KeplerOrbits& orbits, int count);
+void drawOuterBelt(KeplerOrbits& orbits, ThreadPool& jobs, Shader& objShader, Model& objModel, PositionBuffer& positions);
+void drawOuterBeltGpu(KeplerOrbits& orbits, double time, Shader& objShader, UniformHandle timeLoc, Model& objModel, OrbitBuffer& elements);
 
 const unsigned int SCR_WIDTH = 1200;
 const unsigned int SCR_HEIGHT = 800;
@@ -39,7 +109,7 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 
 float deltaTime = 0.0f; //time between current frame and last frame
-float lastFrame = 0.0f; //time of last frame
+double lastFrame = 0.0; //time of last frame, a double so it's still exact after days of uptime
 
 bool shift = false; //faster camera movement
 bool press, prev_press; //helper variables
@@ -52,6 +122,7 @@ bool flip = false; //flipping the rotation for cat dance, see whiteboard
 float angle = 0; //gato angle
 float angular_speed = 0; //gato angular speed
 int cat_cnt = 1; //gato count
+int textureBudgetKB = 4096; //how much texture data gets uploaded per frame while streaming
 
 //these ones should be self explanatory
 float earthDistance = -3.0f;
@@ -63,22 +134,58 @@ float shipDistance = 0.1f;
 float shipSpeed = 50.0f;
 float shipTilt = -30.0f;
 float saturnDistance = 4.5f;
-float saturnSpeed = -30.0f;
 float saturnSpin = -190.0f;
 float saturnTilt = -10.f;
 bool stopEarth = false;
 bool stopMoon = false;
 bool stopShip = false;
-bool multiTrackDrifting = false; //except this one, enables fast star orbits
+bool multiTrackDrifting = false; //except this one, drags the stars into a tight fast orbit
+int asteroidCount = 256; //bodies in the belt outside saturn, every one of them pulls on every other one
+float timeScale = 1.f;
+bool simulationPaused = false;
+bool barnesHut = false; //tree gravity instead of every body on every body
+float openingAngle = 0.5f;
+unsigned int orbitResets = 0;
+int outerBeltCount = 20000; //further out again and on rails, only the stars hold them so they're cheap by the million
+bool gpuOrbits = false; //outer belt moved by orbit.vs from elements uploaded once, instead of positions every frame
+bool frustumCulling = true;
+Frustum viewFrustum; //this frame's, every draw checks against it before touching GL
+unsigned int visibleCount = 0, culledCount = 0; //objects and instances this frame
+//everything drawable goes into the bvh each frame, these first and then the asteroids in body order
+const char* sceneObjectNames[] = { "blue star", "orange star", "earth", "moon", "ship", "saturn", "saturn's rings" };
+const unsigned int SCENE_OBJECTS = 7;
+int pickedObject = -1; //bvh item under the last click, -1 for nothing
+bool pickHeld = false;
+//outline style of everything drawn, written per pixel into the object id buffer for OutlinePass
+//0 is the background, the only thing outlines get drawn over, and everything from 2 up has its own style
+const int OUTLINE_NONE = 1; //drawn but never outlined, the belts and the lightscreen
+const int OUTLINE_STAR_BLUE = 2;
+const int OUTLINE_STAR_ORANGE = 3;
+const int OUTLINE_EARTH = 4;
+const int OUTLINE_MOON = 5;
+const int OUTLINE_SHIP = 6;
+const int OUTLINE_SATURN = 7; //rings and all
+const int OUTLINE_DEVOURER = 8;
+const char* outlineNames[] = { "", "", "Blue star", "Orange star", "Earth", "Moon", "Ship", "Saturn", "Devourer" };
+
+//where each body lives in the n-body arrays, setupBodies adds them in this order and nothing ever removes one
+//constants so both threads can read them without sharing anything
+const unsigned int STAR_BLUE_BODY = 0;
+const unsigned int STAR_ORANGE_BODY = 1;
+const unsigned int EARTH_BODY = 2;
+const unsigned int SATURN_BODY = 3;
+const unsigned int FIRST_ASTEROID = 4;
 
 //array for color background, redundant
 //float colorBackground[4] = { 0.2f, 0.2f, 0.2f, 1.0f };
 
-//vec3 array for the positions of light sources
-glm::vec3 pointLightPositions[] = {
+//vec3 array for the positions of light sources, these are the starting points, gravity moves them from there
+//where the stars start, the simulation thread resets to these since pointLightPositions belongs to the render thread
+const glm::vec3 starStartPositions[] = {
 	glm::vec3(-0.3f, 0.0f, 0.0f), //change to 10 :3
 	glm::vec3(0.7f, 0.0f, 0.0f)
 };
+glm::vec3 pointLightPositions[] = { starStartPositions[0], starStartPositions[1] };
 
 //same for colors
 glm::vec3 pointLightColors[] = {
@@ -87,8 +194,20 @@ glm::vec3 pointLightColors[] = {
 };
 
 
-int main()
+int main(int argc, char** argv)
 {
+	//--bench-gravity [theta] and --bench-kepler time the solvers without opening a window
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--bench-gravity") == 0) {
+			runGravityBenchmark(i + 1 < argc ? (float)atof(argv[i + 1]) : 0.5f);
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench-kepler") == 0) {
+			runKeplerBenchmark();
+			return 0;
+		}
+	}
+
 	//init GLFW
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -129,8 +248,6 @@ int main()
 	//Configuring global OpenGL states
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS);
-	glEnable(GL_STENCIL_TEST);
-	glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
 
 	//Stuff for skybox, doing it manually cuz rewriting the model/mesh loading JUST to account for
 	//this one cube would be ass
@@ -183,7 +300,7 @@ int main()
 	unsigned int skyboxVAO, skyboxVBO;
 	glGenVertexArrays(1, &skyboxVAO);
 	glGenBuffers(1, &skyboxVBO);
-	glBindVertexArray(skyboxVAO);
+	glState().bindVertexArray(skyboxVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
@@ -197,14 +314,17 @@ int main()
 		".\\models\\cubemap\\front.png",
 		".\\models\\cubemap\\back.png"
 	};
-	unsigned int cubemapTexture = loadCubemap(faces);
 	//End skybox
 
 	//Loading all shaders
-	Shader objShader(".\\shaders\\shader.vs", ".\\shaders\\shader.fs");
-	Shader lightShader(".\\shaders\\light.vs", ".\\shaders\\light.fs");
+	//the regular objects and the stars, transforms come in per instance, or per draw when DrawBatch sends them
+	Shader objInstancedShader(".\\shaders\\instanced.vs", ".\\shaders\\shader.fs");
+	Shader lightShader(".\\shaders\\instanced.vs", ".\\shaders\\light.fs");
 	Shader skyboxShader(".\\shaders\\skybox.vs", ".\\shaders\\skybox.fs");
-	Shader outlineShader(".\\shaders\\light.vs", ".\\shaders\\outline.fs");
+	//just a position and size per instance
+	Shader objPositionsShader(".\\shaders\\positions.vs", ".\\shaders\\shader.fs");
+	//or orbital elements per instance, the shader works out where they are
+	Shader objOrbitShader(".\\shaders\\orbit.vs", ".\\shaders\\shader.fs");
 
 	//Model paths
 	char catPath[] = ".\\models\\maxwell\\maxwell.obj";
@@ -216,92 +336,316 @@ int main()
 	char shipPath[] = ".\\models\\enterprise\\enterprise.obj";
 	char saturnPath[] = ".\\models\\saturn\\saturn.obj";
 	char ringPath[] = ".\\models\\saturn\\rings.obj";
-	char ringsOutPath[] = ".\\models\\saturn\\rings_outline.obj";
 
 	//Loading akk the models
-	Model catModel(catPath);
-	Model starBlueModel(starBluePath);
-	Model starOrangeModel(starOrangePath);
-	Model earthModel(earthPath);
-	Model moonModel(moonPath); //to Elsweyr
-	Model cubeModel(cubePath);
-	Model shipModel(shipPath); //engage
-	Model saturnModel(saturnPath);
-	Model ringsModel(ringPath);
-	Model ringsOutModel(ringsOutPath);
+	//timed so we can see what the mesh cache buys us, first run is cold (assimp), every run after is warm
+	//parsing and image decoding happen on the worker threads, the render loop starts right away
+	//and uploads whatever is ready each frame, textures start as placeholders and sharpen as they stream in
+	std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+	//the one job pool, loading, gravity, the outer belt and instance transforms all share its workers
+	ThreadPool jobs;
+	AssetLoader loader(jobs);
+	unsigned int cubemapTexture = loader.loadCubemap(faces);
+	Model catModel;
+	Model starBlueModel;
+	Model starOrangeModel;
+	Model earthModel;
+	Model moonModel; //to Elsweyr
+	Model cubeModel;
+	Model shipModel; //engage
+	Model saturnModel;
+	Model ringsModel;
+	//the ones drawn by the thousand get compact vertices, half the memory and fetch bandwidth
+	loader.loadModel(catModel, catPath, VERTEX_COMPACT);
+	loader.loadModel(starBlueModel, starBluePath);
+	loader.loadModel(starOrangeModel, starOrangePath);
+	loader.loadModel(earthModel, earthPath);
+	loader.loadModel(moonModel, moonPath, VERTEX_COMPACT);
+	loader.loadModel(cubeModel, cubePath, VERTEX_COMPACT);
+	loader.loadModel(shipModel, shipPath);
+	loader.loadModel(saturnModel, saturnPath);
+	loader.loadModel(ringsModel, ringPath);
+	ringsModel.transparent = true;
+	Model* allModels[] = { &catModel, &starBlueModel, &starOrangeModel, &earthModel, &moonModel,
+		&cubeModel, &shipModel, &saturnModel, &ringsModel };
+	const int modelCount = sizeof(allModels) / sizeof(allModels[0]);
+	double modelLoadMs = 0.0; //set once everything, textures included, is on the GPU
+	bool warmStart = false;
 
 	//Manually setting up the skybox shader to use the textures
 	skyboxShader.use();
 	skyboxShader.setInt("skybox", 0);
 
+	//every program reads camera and lights from the same FrameData block
+	FrameUniformBuffer frameUniforms;
+	frameUniforms.attach(lightShader);
+	frameUniforms.attach(skyboxShader);
+	frameUniforms.attach(objInstancedShader);
+	frameUniforms.attach(objPositionsShader);
+	frameUniforms.attach(objOrbitShader);
+
+	//since all the regular objects use objInstancedShader, I decided to preload it with all the information
+	//this means all objects have the same shininess and ambience, but it's not /that/ noticeable and it looks neater
+	objInstancedShader.use();
+	objInstancedShader.setVec3("material.ambient", 1.0f, 1.0f, 1.0f);
+	objInstancedShader.setFloat("material.shininess", 32.0f);
+	objPositionsShader.use();
+	objPositionsShader.setVec3("material.ambient", 1.0f, 1.0f, 1.0f);
+	objPositionsShader.setFloat("material.shininess", 32.0f);
+	objOrbitShader.use();
+	objOrbitShader.setVec3("material.ambient", 1.0f, 1.0f, 1.0f);
+	objOrbitShader.setFloat("material.shininess", 32.0f);
+
+	//material samplers sit on fixed units, so they're set once here instead of on every mesh draw
+	Material::assignSamplerUnits(lightShader);
+	Material::assignSamplerUnits(objInstancedShader);
+	Material::assignSamplerUnits(objPositionsShader);
+	Material::assignSamplerUnits(objOrbitShader);
+	//the belts only ever draw one thing each, so their outline id never changes
+	objPositionsShader.use();
+	objPositionsShader.setInt(objPositionsShader.objectIdLoc, OUTLINE_NONE);
+	objOrbitShader.use();
+	objOrbitShader.setInt(objOrbitShader.objectIdLoc, OUTLINE_NONE);
+	//set every frame, so looked up once here
+	UniformHandle orbitTimeLoc = objOrbitShader.handle("time");
+
+	//the main pass draws into its targets and it puts the frame on screen with the outlines found from the object ids
+	OutlinePass outlines;
+	for (int i = OUTLINE_STAR_BLUE; i <= OUTLINE_DEVOURER; i++) {
+		outlines.styles[i].width = 3.f;
+	}
+	outlines.styles[OUTLINE_STAR_BLUE].color = pointLightColors[0];
+	outlines.styles[OUTLINE_STAR_ORANGE].color = pointLightColors[1];
+
+	//the stars, planets, ship and lightscreen are queued up and go out together a material at a time
+	DrawBatch batch((GLADloadproc)glfwGetProcAddress);
+
+	//transforms for the whole devourer ring, rebuilt and uploaded once per pass
+	InstanceBuffer devourerInstances;
+
+	//gravity runs on its own thread at the clock's fixed rate and hands finished batches of steps over through
+	//a triple buffer, neither side ever waits for the other, the render thread draws in between the last two
+	Simulation simulation;
+	simulation.bodies.timeStep = (float)simulation.clock.stepSeconds;
+	setupBodies(simulation.bodies, asteroidCount);
+	{
+		BodySnapshot& first = simulation.snapshots.back();
+		copyPositions(simulation.bodies, first.current);
+		first.previous = first.current;
+		first.stepSeconds = simulation.clock.stepSeconds;
+		first.published = std::chrono::steady_clock::now();
+		simulation.snapshots.publish();
+	}
+	std::thread simulationThread(simulationLoop, std::ref(simulation), std::ref(jobs));
+	uint64_t sceneTick = 0; //how far the scene graph's own angles have been stepped
+	Bvh sceneBvh;
+	vector<glm::vec4> sceneSpheres;
+	vector<unsigned int> sceneVisible, visibleAsteroids, nearby;
+	//worker utilisation over the last half second, the counters are cumulative so we keep the previous sample
+	vector<ThreadPool::WorkerStats> jobStats, jobStatsLast;
+	vector<float> jobUtilisation;
+	double jobStatsTime = 0.0;
+	InstanceBuffer asteroidInstances;
+	//the outer belt is evaluated straight from its orbital elements each frame
+	KeplerOrbits outerBelt;
+	setOuterBeltCount(outerBelt, outerBeltCount);
+	PositionBuffer outerBeltPositions;
+	OrbitBuffer outerBeltElements;
+
+	//the whole system as a hierarchy, every body hangs off an orbit node so its own spin and scale
+	//don't leak into whatever orbits it, the orbit nodes of simulated bodies just follow them around
+	SceneGraph scene;
+	int starBlueOrbit = scene.addNode();
+	scene[starBlueOrbit].offset = pointLightPositions[0];
+	int starBlue = scene.addNode(starBlueOrbit);
+	scene[starBlue].spinRate = -10.f;
+	scene[starBlue].scale = 0.5f;
+	int starOrangeOrbit = scene.addNode();
+	scene[starOrangeOrbit].offset = pointLightPositions[1];
+	int starOrange = scene.addNode(starOrangeOrbit);
+	scene[starOrange].spinRate = -10.f;
+	scene[starOrange].scale = 0.2f;
+
+	int earthOrbit = scene.addNode();
+	int earth = scene.addNode(earthOrbit);
+	scene[earth].spinRate = earthSpin;
+	scene[earth].scale = 0.2f;
+
+	//the moon orbits the earth's orbit frame, not the spinning earth, and turns to face it
+	//it stays on rails, no earth light enough to leave the stars alone can hold a moon this far out
+	int moonOrbit = scene.addNode(earthOrbit);
+	scene[moonOrbit].orbitRate = moonSpeed;
+	scene[moonOrbit].offset = glm::vec3(0.f, 0.f, moonDistance);
+	scene[moonOrbit].tiltAxis = glm::vec3(0.f, 1.f, 0.f);
+	scene[moonOrbit].tilt = -90.f;
+	int moon = scene.addNode(moonOrbit);
+	scene[moon].scale = 0.05f;
+
+	//engage
+	int shipOrbit = scene.addNode(moonOrbit);
+	scene[shipOrbit].inclinationAxis = glm::vec3(0.f, 0.f, 1.f);
+	scene[shipOrbit].inclination = shipTilt;
+	scene[shipOrbit].orbitAxis = glm::vec3(1.f, 0.f, 0.f);
+	scene[shipOrbit].orbitRate = shipSpeed;
+	scene[shipOrbit].offset = glm::vec3(0.f, shipDistance, 0.f);
+	int ship = scene.addNode(shipOrbit);
+	scene[ship].scale = 0.02f;
+
+	//the rings are drawn with saturn's own matrix, so they don't need a node
+	int saturnOrbit = scene.addNode();
+	int saturn = scene.addNode(saturnOrbit);
+	scene[saturn].tiltAxis = glm::vec3(1.f, 0.f, 0.f);
+	scene[saturn].tilt = saturnTilt;
+	scene[saturn].spinRate = saturnSpin;
+	scene[saturn].scale = 0.3f;
+
 	//main render loop
 	while (!glfwWindowShouldClose(window))
 	{
-		//calculating deltaTime for uniform movement
-		float currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
+		//calculating deltaTime for uniform movement, only the camera and the cat's wiggle use it directly
+		double currentFrame = glfwGetTime();
+		double frameSeconds = currentFrame - lastFrame;
+		deltaTime = (float)frameSeconds;
 		lastFrame = currentFrame;
 
 		processInput(window);
 		glfwGetWindowSize(window, &width, &height);
+		glState().resetCounters();
+
+		//whatever finished loading since last frame, within the texture budget so a slow disk never stalls a frame
+		if (!loader.idle()) {
+			loader.update((size_t)textureBudgetKB * 1024);
+			if (loader.idle()) {
+				modelLoadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+				int warmModels = 0;
+				for (Model* loaded : allModels) {
+					warmModels += loaded->loadedFromCache;
+				}
+				warmStart = warmModels == modelCount;
+				std::cout << "Loaded " << modelCount << " models in " << modelLoadMs << " ms (" << (warmStart ? "warm" : "cold") << ", "
+					<< warmModels << "/" << modelCount << " from mesh cache, " << jobs.size() << " worker threads)" << std::endl;
+			}
+		}
 
-		//stencil buffer keeps values if the stencil test fails, if the stencil test passes but the depth test fails, and replaces the value
-		//with what is set in glStencilFunc if both tests pass
-		glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-
-		//clearing screen and all the buffers
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		//binding and clearing the outline pass's colour, object id and depth buffers, everything up to the skybox goes in there
+		int framebufferWidth, framebufferHeight;
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		outlines.begin(framebufferWidth, framebufferHeight);
 
 
 		// pass projection matrix to shader (note that in this case it could change every frame)
 		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)width / (float)height, 0.1f, 100.0f);
 		//view matrix transforms the scene to be viewed from the perspective of the camera, neat!
 		glm::mat4 view = camera.GetViewMatrix();
+		viewFrustum = frustumCulling ? camera.GetFrustum(projection) : Frustum();
+		visibleCount = culledCount = 0;
+
+		//whatever the UI set last frame goes over to the simulation thread
+		SimSettings& settings = simulation.settings.back();
+		settings.timeScale = timeScale;
+		settings.paused = simulationPaused;
+		settings.stopEarth = stopEarth;
+		settings.mergeStars = multiTrackDrifting;
+		settings.asteroidCount = asteroidCount;
+		settings.barnesHut = barnesHut;
+		settings.openingAngle = openingAngle;
+		settings.resets = orbitResets;
+		simulation.settings.publish();
+
+		//newest finished batch, the scene graph steps through the same ticks so everything stays in lockstep
+		//stopped bodies keep their cached matrices, nothing below them is rebuilt unless a parent moved
+		scene[moonOrbit].paused = stopMoon;
+		scene[shipOrbit].paused = stopShip;
+		if (simulation.snapshots.update()) {
+			const BodySnapshot& latest = simulation.snapshots.front();
+			if (latest.firstTick > sceneTick) {
+				scene.advance(latest.stepSeconds, (unsigned int)(latest.firstTick - sceneTick));
+			}
+			scene.advance(latest.stepSeconds, (unsigned int)(latest.tick - latest.firstTick));
+			sceneTick = latest.tick;
+		}
+		const BodySnapshot& snapshot = simulation.snapshots.front();
+		double sincePublished = std::chrono::duration<double>(std::chrono::steady_clock::now() - snapshot.published).count();
+		float alpha = snapshot.span > 0.0 ? (float)std::min(sincePublished / snapshot.span, 1.0) : 1.f;
+		double simTime = snapshot.time(alpha);
+		if (outerBeltCount != (int)outerBelt.count()) {
+			setOuterBeltCount(outerBelt, outerBeltCount);
+		}
+		//the outer belt is worked out at the exact time we're drawing, no steps to blend
+		if (!gpuOrbits) {
+			outerBelt.propagate(simTime, &jobs);
+		}
+		int followers[][2] = { { starBlueOrbit, (int)STAR_BLUE_BODY }, { starOrangeOrbit, (int)STAR_ORANGE_BODY },
+			{ earthOrbit, (int)EARTH_BODY }, { saturnOrbit, (int)SATURN_BODY } };
+		for (int i = 0; i < 4; i++) {
+			scene[followers[i][0]].offset = snapshot.position(followers[i][1], alpha);
+			scene[followers[i][0]].markDirty();
+		}
+		scene.update(alpha);
+		pointLightPositions[0] = snapshot.position(STAR_BLUE_BODY, alpha);
+		pointLightPositions[1] = snapshot.position(STAR_ORANGE_BODY, alpha);
+
+		//world bounds of everything into the bvh, refit in place unless something was added or removed
+		Model* objectModels[SCENE_OBJECTS] = { &starBlueModel, &starOrangeModel, &earthModel, &moonModel, &shipModel, &saturnModel, &ringsModel };
+		int objectNodes[SCENE_OBJECTS] = { starBlue, starOrange, earth, moon, ship, saturn, saturn };
+		unsigned int asteroidTotal = snapshot.current.size() > FIRST_ASTEROID ? (unsigned int)snapshot.current.size() - FIRST_ASTEROID : 0;
+		sceneSpheres.resize(SCENE_OBJECTS + asteroidTotal);
+		for (unsigned int i = 0; i < SCENE_OBJECTS; i++) {
+			sceneSpheres[i] = objectModels[i]->bounds().sphere(scene[objectNodes[i]].world);
+		}
+		const Bounds& asteroidBounds = moonModel.bounds();
+		for (unsigned int i = 0; i < asteroidTotal; i++) {
+			sceneSpheres[SCENE_OBJECTS + i] = glm::vec4(snapshot.position(FIRST_ASTEROID + i, alpha) + asteroidBounds.center * 0.01f, asteroidBounds.radius * 0.01f);
+		}
+		sceneBvh.update(sceneSpheres.data(), (unsigned int)sceneSpheres.size());
+		sceneVisible.clear();
+		sceneBvh.queryFrustum(viewFrustum, sceneVisible);
+		unsigned int frustumNodes = sceneBvh.nodesVisited;
+		visibleAsteroids.clear();
+		for (unsigned int i = 0; i < sceneVisible.size(); i++) {
+			if (sceneVisible[i] >= SCENE_OBJECTS) {
+				visibleAsteroids.push_back(FIRST_ASTEROID + sceneVisible[i] - SCENE_OBJECTS);
+			}
+		}
+		//picking, a left click with the cursor let go (enter) that isn't on the panel
+		bool click = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+		if (click && !pickHeld && !camera.Active && !ImGui::GetIO().WantCaptureMouse) {
+			double cursorX, cursorY;
+			int windowWidth, windowHeight;
+			glfwGetCursorPos(window, &cursorX, &cursorY);
+			glfwGetWindowSize(window, &windowWidth, &windowHeight);
+			glm::vec3 direction = camera.GetRayDirection((float)cursorX, (float)cursorY, (float)windowWidth, (float)windowHeight, projection);
+			float distance;
+			pickedObject = sceneBvh.raycast(camera.Position, direction, distance);
+		}
+		pickHeld = click;
+		if (pickedObject >= (int)sceneSpheres.size()) {
+			pickedObject = -1;
+		}
 
-		//presetting all shaders with the projection and view matrices, as they only change once per frame
-		lightShader.use();
-		lightShader.setMat4("projection", projection);
-		lightShader.setMat4("view", view);
-
-		outlineShader.use();
-		outlineShader.setMat4("projection", projection);
-		outlineShader.setMat4("view", view);
-
-		objShader.use();
-		objShader.setMat4("projection", projection);
-		objShader.setMat4("view", view);
-		//since all the regular objects use objShader, I decided to preload it with all the information
-		//this means all objects have the same shininess and ambience, but it's not /that/ noticeable and it looks neater
-		//could've shoved this all in a function. too bad!
-		objShader.setVec3("viewPos", camera.Position);
-		objShader.setVec3("material.ambient", 1.0f, 1.0f, 1.0f);
-		objShader.setFloat("material.shininess", 32.0f);
-		for (int i = 0; i < 2; i++) {
-			objShader.setVec3("pointLights[" + std::to_string(i) + "].position", pointLightPositions[i]);
-			objShader.setVec3("pointLights[" + std::to_string(i) + "].ambient", pointLightColors[i] * 0.05f);
-			objShader.setVec3("pointLights[" + std::to_string(i) + "].diffuse", pointLightColors[i]);
-			objShader.setVec3("pointLights[" + std::to_string(i) + "].specular", pointLightColors[i]);
-			objShader.setFloat("pointLights[" + std::to_string(i) + "].constant", 1.0f);
-			objShader.setFloat("pointLights[" + std::to_string(i) + "].linear", 0.0014f);
-			objShader.setFloat("pointLights[" + std::to_string(i) + "].quadratic", 0.000007f);
-		}
-
-		glStencilFunc(GL_ALWAYS, 1, 0xFF);//all fragments pass the stencil test
-		glStencilMask(0xFF);//enable writing to the stencil buffer
+		//camera and lights only change once per frame, so they go into the shared uniform buffer in a single upload
+		frameUniforms.data.view = view;
+		frameUniforms.data.projection = projection;
+		frameUniforms.data.viewPos = glm::vec4(camera.Position, 1.0f);
+		for (int i = 0; i < NR_POINT_LIGHTS; i++) {
+			PointLightStd140& light = frameUniforms.data.pointLights[i];
+			light.position = pointLightPositions[i];
+			light.ambient = pointLightColors[i] * 0.05f;
+			light.diffuse = pointLightColors[i];
+			light.specular = pointLightColors[i];
+			light.constant = 1.0f;
+			light.linear = 0.0014f;
+			light.quadratic = 0.000007f;
+		}
+		frameUniforms.upload();
 
 		//drawing scene
 		glm::mat4 model = glm::mat4(1.0f);
-		glm::mat3 normal = glm::mat3(1.0f);
-
-		//since I had to get *creative* with the star rotations, I do the rotation manually on the position vectors and then just multiply
-		glm::mat4 rotate = glm::mat4(1.0f);
-		rotate = glm::rotate(rotate, glm::radians(deltaTime * (10.f + (multiTrackDrifting * 600.f))), glm::vec3(0, 1, 0));
-		pointLightPositions[0] = pointLightPositions[0] * glm::mat3(rotate);
-		pointLightPositions[1] = pointLightPositions[1] * glm::mat3(rotate);
+		batch.begin(camera.Position);
 
 		//see function for comments
-		drawStar(currentFrame, lightShader, starBlueModel, pointLightPositions[0], 0.5f, 0.5f, false);
-		drawStar(currentFrame, lightShader, starOrangeModel, pointLightPositions[1], 0.2f, 0.5f, false);
+		drawModel(batch, scene[starBlue].world, lightShader, starBlueModel, OUTLINE_STAR_BLUE);
+		drawModel(batch, scene[starOrange].world, lightShader, starOrangeModel, OUTLINE_STAR_ORANGE);
 
 		//if we selected the lightscreen for drawing, it's... well, drawn
 		//what else do you want me to say?
@@ -309,130 +653,43 @@ int main()
 			model = glm::mat4(1.0f);
 			model = glm::translate(model, glm::vec3(0.f, 0.f, -2.f));
 			model = glm::scale(model, glm::vec3(1.f, 0.2f, 0.2f));
-			drawModel(model, objShader, cubeModel, false);
+			drawModel(batch, model, objInstancedShader, cubeModel, OUTLINE_NONE);
 		}
 
 		//same for the kitty (his name is Maxwell)
 		if (devourer) {
-			drawDevourer(currentFrame, objShader, catModel, spin, false);
+			drawDevourer(simTime, objInstancedShader, catModel, devourerInstances, spin, OUTLINE_DEVOURER);
 		}
 
-		earthSpeed = -30.0f;
-		moonSpeed = -90.0f;
-		shipSpeed = 50.0f;
-		if (stopEarth) {
-			earthSpeed = 0.0f;
-		}
-		if (stopMoon) {
-			moonSpeed = 0.0f;
-		}
-		if (stopShip) {
-			shipSpeed = 0.0f;
+		drawModel(batch, scene[earth].world, objInstancedShader, earthModel, OUTLINE_EARTH);
+		drawModel(batch, scene[moon].world, objInstancedShader, moonModel, OUTLINE_MOON);
+		drawModel(batch, scene[ship].world, objInstancedShader, shipModel, OUTLINE_SHIP);
+		drawModel(batch, scene[saturn].world, objInstancedShader, saturnModel, OUTLINE_SATURN);
+		drawModel(batch, scene[saturn].world, objInstancedShader, ringsModel, OUTLINE_SATURN);
+		batch.flush(RENDER_PASS_OPAQUE);
+		drawAsteroids(snapshot, alpha, visibleAsteroids, jobs, objInstancedShader, moonModel, asteroidInstances);
+		if (gpuOrbits) {
+			drawOuterBeltGpu(outerBelt, simTime, objOrbitShader, orbitTimeLoc, cubeModel, outerBeltElements);
+		} else {
+			drawOuterBelt(outerBelt, jobs, objPositionsShader, cubeModel, outerBeltPositions);
 		}
 
-		model = glm::mat4(1.0f);
-		movePlanet(model, currentFrame, earthSpeed, earthDistance, earthSpin);
-		model = glm::scale(model, glm::vec3(0.2f));
-		drawModel(model, objShader, earthModel, false);
-
-		model = glm::mat4(1.0f);
-		movePlanet(model, currentFrame, earthSpeed, earthDistance, earthSpin);
-		moveMoon(model, currentFrame, moonSpeed, moonDistance, earthSpin);
-		model = glm::scale(model, glm::vec3(0.05));
-		drawModel(model, objShader, moonModel, false);
-
-		model = glm::mat4(1.0f);
-		movePlanet(model, currentFrame, earthSpeed, earthDistance, earthSpin);
-		moveMoon(model, currentFrame, moonSpeed, moonDistance, earthSpin);
-		moveShip(model, currentFrame, shipSpeed, shipDistance, shipTilt);
-		model = glm::scale(model, glm::vec3(0.02));
-		drawModel(model, objShader, shipModel, false);
-
-		model = glm::mat4(1.0f);
-		model = glm::rotate(model, glm::radians(currentFrame * saturnSpeed), glm::vec3(0, 1.f, 0));
-		model = glm::translate(model, glm::vec3(0.f, 0.f, saturnDistance));
-		model = glm::rotate(model, glm::radians(saturnTilt), glm::vec3(1, 0, 0));
-		model = glm::rotate(model, glm::radians(currentFrame * saturnSpin), glm::vec3(0, 1.f, 0));
-		model = glm::scale(model, glm::vec3(0.3f));
-		drawModel(model, objShader, saturnModel, false);
-		drawModel(model, objShader, ringsModel, false);
-
 		// Drawing Skybox
 		glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-		glDisable(GL_STENCIL_TEST); //disable stencil testing so it can be drawn later on
-		skyboxShader.use();
-		view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
-		skyboxShader.setMat4("view", view);
-		skyboxShader.setMat4("projection", projection);
+		skyboxShader.use(); // the translation is stripped off the shared view matrix in skybox.vs
 		// skybox cube
-		glBindVertexArray(skyboxVAO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+		glState().bindVertexArray(skyboxVAO);
+		glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
 		glDrawArrays(GL_TRIANGLES, 0, 36);
-		glBindVertexArray(0);
 		glDepthFunc(GL_LESS); // set depth function back to default
-		glEnable(GL_STENCIL_TEST); 
-		
-		if (global_outline) {
-			//set the stencil function to GL_NOTEQUAL to make sure that were only drawing parts of the
-			//objects that are not equal to 1
-			glStencilFunc(GL_NOTEQUAL, 1, 0xFF); 
-			//each bit ends up as 0 (disabling writes)
-			glStencilMask(0x00); 
-			//disable depth testing so the scaled up containers
-			//(e.g.the borders) do not get overwritten by the floor.
-			glDisable(GL_DEPTH_TEST);
-
-			//redrawing everything with the last value set true for outlining
-			drawStar(currentFrame, outlineShader, starBlueModel, pointLightPositions[0], 0.5f, 0.5f, true);
-			drawStar(currentFrame, outlineShader, starOrangeModel, pointLightPositions[1], 0.2f, 0.5f, true);
 
-			model = glm::mat4(1.0f);
-			movePlanet(model, currentFrame, earthSpeed, earthDistance, earthSpin);
-			model = glm::scale(model, glm::vec3(0.2f));
-			drawModel(model, outlineShader, earthModel, true);
-
-			model = glm::mat4(1.0f);
-			movePlanet(model, currentFrame, earthSpeed, earthDistance, earthSpin);
-			moveMoon(model, currentFrame, moonSpeed, moonDistance, earthSpin);
-			model = glm::scale(model, glm::vec3(0.05));
-			drawModel(model, outlineShader, moonModel, true);
-
-			model = glm::mat4(1.0f);
-			movePlanet(model, currentFrame, earthSpeed, earthDistance, earthSpin);
-			moveMoon(model, currentFrame, moonSpeed, moonDistance, earthSpin);
-			moveShip(model, currentFrame, shipSpeed, shipDistance, shipTilt);
-			model = glm::scale(model, glm::vec3(0.02));
-			drawModel(model, outlineShader, shipModel, true);
-
-			objShader.use();
-			model = glm::mat4(1.0f);
-			model = glm::rotate(model, glm::radians(currentFrame * saturnSpeed), glm::vec3(0, 1.f, 0));
-			model = glm::translate(model, glm::vec3(0.f, 0.f, saturnDistance));
-			model = glm::rotate(model, glm::radians(saturnTilt), glm::vec3(1, 0, 0));
-			model = glm::rotate(model, glm::radians(currentFrame * saturnSpin), glm::vec3(0, 1.f, 0));
-			model = glm::scale(model, glm::vec3(0.3f));
-			model = glm::scale(model, glm::vec3(1.1f));
-			drawModel(model, outlineShader, saturnModel, true);
-			model = glm::scale(model, glm::vec3(0.9f));
-			//I'm a fraud- well, kinda.
-			//you can't make decent outlines for the rings because they get scaled outwards, leaving the inner parts to
-			//not get outlined at all. so i just added a separate model that scales the inner ring a little and disabled
-			//the extra scaling by the bool value, because we are reusing the model matrix from drawing the main planet
-			//which was already scaled up
-			//way too much text for a single line of code
-			drawModel(model, outlineShader, ringsOutModel, false);
-
-			//devourer
-			if (devourer) {
-				drawDevourer(currentFrame, outlineShader, catModel, spin, true);
-			}
-			//bring values back to standard and enable the depthj test
-			glStencilMask(0xFF);
-			glStencilFunc(GL_ALWAYS, 1, 0xFF);
-			glEnable(GL_DEPTH_TEST);
-		}
+		//the rings, blended over everything including the skybox, so they have to come after it
+		batch.flush(RENDER_PASS_TRANSPARENT);
 		
+		//outlines and the finished frame onto the screen, a few full screen passes whatever's in view
+		outlines.enabled = global_outline;
+		outlines.resolve();
+
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();
@@ -448,13 +705,111 @@ int main()
 		ImGui::Checkbox("Stop Ship", &stopShip);
 		ImGui::Checkbox("Devourer", &devourer);
 		if (devourer) {
-			ImGui::SliderInt("Devourers", &cat_cnt, 1, 10);
+			ImGui::SliderInt("Devourers", &cat_cnt, 1, 1000);
 			ImGui::Checkbox("Spin", &spin);
 		}
+		if (loader.idle()) {
+			ImGui::Text("Model load: %.1f ms (%s)", modelLoadMs, warmStart ? "warm" : "cold");
+		} else {
+			ImGui::Text("Loading: %u models, %u textures left (%.1f MB this frame)", loader.modelsPending(),
+				loader.texturesPending(), loader.textureBytesLastFrame() / (1024.0 * 1024.0));
+		}
+		ImGui::SliderInt("Texture upload KB/frame", &textureBudgetKB, 64, 16384);
+		ImGui::Text("Textures: %u unique of %u requested, %.1f MB on GPU, %.1f MB saved", textureRegistry().uniqueCount(),
+			textureRegistry().requestCount(), textureRegistry().gpuBytes() / (1024.0 * 1024.0), textureRegistry().savedBytes() / (1024.0 * 1024.0));
+		ImGui::Text("Texture cache: %u mapped, %u baked (%s)", loader.texturesFromCache(), loader.texturesBaked(),
+			loader.compressingTextures() ? "BC1/BC3" : "uncompressed");
+		ImGui::Text("State changes: %u issued, %u skipped", glState().issued, glState().skipped);
+		for (int f = 0; f < VERTEX_FORMATS; f++) {
+			GeometryArena& arena = geometryArena((VertexFormat)f);
+			ImGui::Text("Geometry arena (%s): %u meshes, %.1f MB of %.1f MB, grown %u times", f == VERTEX_COMPACT ? "compact" : "full",
+				arena.meshCount, arena.bytesUsed() / (1024.0 * 1024.0), arena.bytesReserved() / (1024.0 * 1024.0), arena.growths);
+		}
+		if (batch.indirectSupported()) {
+			ImGui::Checkbox("Multi-draw indirect", &batch.indirect);
+			ImGui::SameLine();
+		}
+		ImGui::Text("Batch: %u draws in %u groups, %u draw calls (%s), %u program and %u material changes", batch.draws, batch.buckets,
+			batch.calls, batch.indirect && batch.indirectSupported() ? "indirect" : "base vertex loop", batch.programChanges, batch.materialChanges);
+		ImGui::Text("Transforms rebuilt: %u of %u", scene.recomputed, (unsigned int)scene.nodes.size());
+		ImGui::Checkbox("Frustum culling", &frustumCulling);
+		ImGui::SameLine();
+		ImGui::Text("%u visible, %u culled", visibleCount, culledCount);
+		ImGui::Text("BVH: %u items, %u nodes, %u subtrees rebuilt (%u items), frustum query %u nodes", sceneBvh.size(),
+			sceneBvh.nodeTotal(), sceneBvh.rebuiltSubtrees, sceneBvh.rebuiltItems, frustumNodes);
+		if (pickedObject >= 0) {
+			//proximity, everything whose bounds come within half a unit of the picked one's
+			glm::vec4 picked = sceneSpheres[pickedObject];
+			nearby.clear();
+			sceneBvh.queryRadius(glm::vec3(picked), picked.w + 0.5f, nearby);
+			if (pickedObject < (int)SCENE_OBJECTS) {
+				ImGui::Text("Picked: %s, %u others nearby", sceneObjectNames[pickedObject], (unsigned int)nearby.size() - 1);
+			} else {
+				ImGui::Text("Picked: asteroid %d, %u others nearby", pickedObject - (int)SCENE_OBJECTS, (unsigned int)nearby.size() - 1);
+			}
+		} else {
+			ImGui::Text("Picked: nothing, free the cursor with enter and click something");
+		}
+		ImGui::SliderFloat("Time scale", &timeScale, 0.f, 8.f);
+		ImGui::SameLine();
+		ImGui::Checkbox("Pause", &simulationPaused);
+		ImGui::Text("Sim time %.2f s, tick %llu", snapshot.time(1.f), (unsigned long long)snapshot.tick);
+		ImGui::SliderInt("Asteroids", &asteroidCount, 0, 4096);
+		ImGui::Text("Bodies: %u, %u steps in the last batch, %.2f ms a step (%s, %u threads)", (unsigned int)snapshot.current.size(),
+			(unsigned int)(snapshot.tick - snapshot.firstTick), snapshot.stepMilliseconds, cpuHasAVX2() ? "AVX2" : "scalar", jobs.size() + 1);
+		ImGui::SliderInt("Outer belt", &outerBeltCount, 0, 1000000);
+		ImGui::Checkbox("Outer belt on GPU", &gpuOrbits);
+		if (gpuOrbits) {
+			ImGui::Text("Outer belt: %u orbits in orbit.vs, %u uploads so far", outerBeltElements.count(), outerBeltElements.uploadCount());
+		} else {
+			ImGui::Text("Outer belt: %u orbits in %.2f ms", outerBelt.count(), outerBelt.propagateMilliseconds);
+		}
+		ImGui::Checkbox("Barnes-Hut gravity", &barnesHut);
+		if (barnesHut) {
+			ImGui::SameLine();
+			ImGui::Text("%u nodes, %.2f ms build", snapshot.treeNodes, snapshot.treeBuildMilliseconds);
+			ImGui::SliderFloat("Opening angle", &openingAngle, 0.f, 1.5f);
+		}
+		if (ImGui::Button("Reset orbits")) {
+			orbitResets++;
+		}
+		if (currentFrame - jobStatsTime >= 0.5) {
+			jobs.stats(jobStats);
+			jobUtilisation.resize(jobStats.size());
+			for (unsigned int i = 0; i < jobStats.size(); i++) {
+				double before = i < jobStatsLast.size() ? jobStatsLast[i].busySeconds : 0.0;
+				jobUtilisation[i] = (float)((jobStats[i].busySeconds - before) / (currentFrame - jobStatsTime));
+			}
+			jobStatsLast = jobStats;
+			jobStatsTime = currentFrame;
+		}
+		if (ImGui::CollapsingHeader("Job system")) {
+			//the last entry is the main and simulation threads, running their own jobs while they wait on them
+			for (unsigned int i = 0; i < jobStats.size(); i++) {
+				if (i + 1 < jobStats.size()) {
+					ImGui::Text("Worker %u: %3.0f%% busy, %llu jobs, %llu stolen", i, jobUtilisation[i] * 100.f,
+						(unsigned long long)jobStats[i].jobs, (unsigned long long)jobStats[i].steals);
+				} else {
+					ImGui::Text("Waiting threads: %3.0f%% busy, %llu jobs", jobUtilisation[i] * 100.f, (unsigned long long)jobStats[i].jobs);
+				}
+			}
+		}
+		if (ImGui::CollapsingHeader("Outlines")) {
+			ImGui::Text("%u flood passes", outlines.floodPasses);
+			for (int i = OUTLINE_STAR_BLUE; i <= OUTLINE_DEVOURER; i++) {
+				ImGui::PushID(i);
+				ImGui::ColorEdit3(outlineNames[i], &outlines.styles[i].color.x, ImGuiColorEditFlags_NoInputs);
+				ImGui::SameLine();
+				ImGui::SliderFloat("px", &outlines.styles[i].width, 0.f, 32.f);
+				ImGui::PopID();
+			}
+		}
 		ImGui::End();
 
 		ImGui::Render();
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		//ImGui binds its own program, VAO and font texture without telling the tracker
+		glState().invalidate();
 		
 
 		//poll events and swap buffers
@@ -462,6 +817,9 @@ int main()
 		glfwPollEvents();
 	}
 
+	simulation.running = false;
+	simulationThread.join();
+
 	//release all GLFW resources and destroy ImGUI menus
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
@@ -469,66 +827,46 @@ int main()
 
 	glDeleteVertexArrays(1, &skyboxVAO);
 	glDeleteBuffers(1, &skyboxVBO);
+	for (Model* loaded : allModels) {
+		loaded->destroy();
+	}
+	geometryArena(VERTEX_FULL).destroy();
+	geometryArena(VERTEX_COMPACT).destroy();
+	frameUniforms.destroy();
+	devourerInstances.destroy();
+	asteroidInstances.destroy();
+	outerBeltPositions.destroy();
+	outerBeltElements.destroy();
+	outlines.destroy();
+	batch.destroy();
 	glfwTerminate();
 	return 0;
 }
 
-//model drawing
-void drawModel(glm::mat4& model, Shader& objShader, Model& objModel, bool outline) {
-	objShader.use();
-	if (outline) {
-		model = glm::scale(model, glm::vec3(1.1f));
-	}
-	//pass normal matrix into the shader cuz otherwise you cannot get updated lighting
-	//and doing it on the GPU is $$$ so it's faster to do it like this
-	glm::mat3 normal = glm::mat3(glm::transpose(glm::inverse(model)));
-	objShader.setMat4("model", model);
-	objShader.setMat3("transNormal", normal);
-	objModel.Draw(objShader);
-}
-
-void drawStar(float currentFrame, Shader& objShader, Model& objModel, glm::vec3& pos, float scale, float max_scale, bool outline) {
-	objShader.use();
-	glm::mat4 model = glm::mat4(1.0f);
-	model = glm::translate(model, pos);
-	model = glm::rotate(model, glm::radians(currentFrame * -10.f), glm::vec3(0, 1.f, 0));
-	model = glm::scale(model, glm::vec3(scale));
-	if (outline) {
-		if (max_scale != scale) {
-			//calculating the distance of the offset
-			//see whiteboard
-			float x = (scale + (max_scale * 1.1f - max_scale)) / scale;
-			model = glm::scale(model, glm::vec3(x));
-
-		} else {
-			model = glm::scale(model, glm::vec3(1.1f));
-		}
+//model drawing, queued into the batch, shader has to read its transform per instance like instanced.vs does
+//the normal matrix goes in with the transform, worked out on the CPU cuz doing it on the GPU is $$$
+void drawModel(DrawBatch& batch, glm::mat4 model, Shader& objShader, Model& objModel, int outlineId) {
+	if (!inView(objModel, model)) {
+		return;
 	}
-	objShader.setMat4("model", model);
-	objModel.Draw(objShader);
+	objModel.DrawBatched(batch, objShader, model, outlineId);
 }
 
-//functions for moving objects around, self explanatory methinks
-void movePlanet(glm::mat4& model, float currentFrame, float orbitSpeed, float orbitDistance, float spinSpeed) {
-	model = glm::rotate(model, glm::radians(currentFrame * orbitSpeed), glm::vec3(0, 1.f, 0));
-	model = glm::translate(model, glm::vec3(0.f, 0.f, orbitDistance));
-	model = glm::rotate(model, glm::radians(currentFrame * spinSpeed), glm::vec3(0, 1.f, 0));
-}
-void moveMoon(glm::mat4& model, float currentFrame, float orbitSpeed, float orbitDistance, float spinSpeed) {
-	model = glm::rotate(model, glm::radians(currentFrame * -spinSpeed), glm::vec3(0, 1.f, 0));
-	model = glm::rotate(model, glm::radians(currentFrame * orbitSpeed), glm::vec3(0, 1.f, 0));
-	model = glm::translate(model, glm::vec3(0.f, 0.f, orbitDistance));
-	model = glm::rotate(model, glm::radians(-90.f), glm::vec3(0, 1.f, 0));
-}
-void moveShip(glm::mat4& model, float currentFrame, float orbitSpeed, float orbitDistance, float tilt) {
-	model = glm::rotate(model, glm::radians(tilt), glm::vec3(0.f, 0.f, 1.f));
-	model = glm::rotate(model, glm::radians(currentFrame * orbitSpeed), glm::vec3(1.f, 0.f, 0.f));
-	model = glm::translate(model, glm::vec3(0.f, orbitDistance, 0.f));
+//the model's bounding sphere against this frame's frustum
+bool inView(const Model& objModel, const glm::mat4& model) {
+	bool visible = viewFrustum.visible(objModel.bounds(), model);
+	(visible ? visibleCount : culledCount)++;
+	return visible;
 }
 
 //easier to explain on a whiteboard
-void drawDevourer(float currentFrame, Shader &objShader, Model &objModel, bool spin, bool outline) {
-	objShader.use();
+//every cat's matrix goes into the instance buffer and the whole ring is a single instanced draw per mesh
+//the ring gets built first and culled as a batch, only the cats in view go into the buffer
+void drawDevourer(double simTime, Shader &objShader, Model &objModel, InstanceBuffer &instances, bool spin, int outlineId) {
+	static vector<glm::mat4> models; //kept between frames so they stop allocating
+	static vector<glm::vec4> spheres;
+	static vector<unsigned int> visible;
+	models.clear();
 	if (!spin) {
 		angular_speed = deltaTime * 60.f;
 		if (angle > 15.f) {
@@ -537,24 +875,18 @@ void drawDevourer(float currentFrame, Shader &objShader, Model &objModel, bool s
 		if (angle < -15.f) {
 			flip = false;
 		}
-		if (!outline) {
-			if (flip) {
-				angle = angle - angular_speed;
-			}
-			else {
-				angle = angle + angular_speed;
-			}
+		if (flip) {
+			angle = angle - angular_speed;
+		}
+		else {
+			angle = angle + angular_speed;
 		}
 		for (int i = 0; i < cat_cnt; i++) {
 			glm::mat4 model = glm::mat4(1.0f);
-			model = glm::rotate(model, glm::radians(currentFrame * -20.f) + 2 * PI * i / cat_cnt, glm::vec3(0, 1.f, 0));
+			model = glm::rotate(model, glm::radians(SimClock::phaseAt(simTime, -20.0)) + 2 * PI * i / cat_cnt, glm::vec3(0, 1.f, 0));
 			model = glm::translate(model, glm::vec3(0.f, -0.2f, -2.0f));
 			model = glm::rotate(model, glm::radians(-20.f), glm::vec3(0, 1.f, 0));
 			model = glm::scale(model, glm::vec3(0.2));
-			if (outline) {
-				model = glm::translate(model, glm::vec3(0.f, -0.1f, 0.0f));
-				model = glm::scale(model, glm::vec3(1.1f));
-			}
 
 			if (angle > 0.0f) {
 				model = glm::translate(model, glm::vec3(0.0f, 0.0f, 1.0f));
@@ -566,24 +898,38 @@ void drawDevourer(float currentFrame, Shader &objShader, Model &objModel, bool s
 				model = glm::rotate(model, glm::radians(angle), glm::vec3(1.f, 0.f, 0.f));
 				model = glm::translate(model, glm::vec3(0.0f, 0.0f, 1.0f));
 			}
-			drawModel(model, objShader, objModel, false);
+			models.push_back(model);
 		}
 	} else {
 		for (int i = 0; i < cat_cnt; i++) {
 			glm::mat4 model = glm::mat4(1.0f);
-			model = glm::rotate(model, glm::radians(currentFrame * -20.f) + 2 * PI * i / cat_cnt, glm::vec3(0, 1.f, 0));
+			model = glm::rotate(model, glm::radians(SimClock::phaseAt(simTime, -20.0)) + 2 * PI * i / cat_cnt, glm::vec3(0, 1.f, 0));
 			model = glm::translate(model, glm::vec3(0.f, -0.2f, -2.0f));
-			model = glm::rotate(model, glm::radians(currentFrame * -800.f), glm::vec3(0, 1.f, 0));
-			model = glm::translate(model, glm::vec3(0.f, glm::sin(currentFrame*10.f)*0.2f, 0.f));
+			model = glm::rotate(model, glm::radians(SimClock::phaseAt(simTime, -800.0)), glm::vec3(0, 1.f, 0));
+			model = glm::translate(model, glm::vec3(0.f, glm::sin(SimClock::phaseAt(simTime, 10.0, 2.0 * PI))*0.2f, 0.f));
 			model = glm::scale(model, glm::vec3(0.2));
-			if (outline) {
-				model = glm::translate(model, glm::vec3(0.f, -0.1f, 0.0f));
-				model = glm::scale(model, glm::vec3(1.1f));
-			}
-			drawModel(model, objShader, objModel, false);
+			models.push_back(model);
 		}
 	}
-	
+	//world space spheres, so the batch test gets a unit sphere for bounds
+	spheres.resize(models.size());
+	for (unsigned int i = 0; i < models.size(); i++) {
+		spheres[i] = objModel.bounds().sphere(models[i]);
+	}
+	Bounds unit;
+	unit.radius = 1.f;
+	visible.clear();
+	viewFrustum.cull(spheres.data(), (unsigned int)spheres.size(), unit, visible);
+	visibleCount += (unsigned int)visible.size();
+	culledCount += (unsigned int)(models.size() - visible.size());
+	instances.clear();
+	for (unsigned int i = 0; i < visible.size(); i++) {
+		instances.push(models[visible[i]]);
+	}
+	instances.upload();
+	objShader.use();
+	objShader.setInt(objShader.objectIdLoc, outlineId);
+	objModel.DrawInstanced(objShader, instances, instances.count());
 }
 
 //provess user input
@@ -649,27 +995,223 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
 	camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
 
-unsigned int loadCubemap(vector<std::string> faces) {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-	int width, height, nrChannels;
-	for (unsigned int i = 0; i < faces.size(); i++) {
-		unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-
-		if (data) {
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
-		} else {
-			std::cout << "Cubemap failed to load at path: " << faces[i]
-				<< std::endl;
-			stbi_image_free(data);
+//keeps the belt small and far from everything, just a lot of it
+//visible is body indices, whatever the bvh found in view, only those get a matrix
+void drawAsteroids(const BodySnapshot& snapshot, float alpha, const vector<unsigned int>& visible, ThreadPool& jobs, Shader& objShader, Model& objModel, InstanceBuffer& instances) {
+	unsigned int total = snapshot.current.size() > FIRST_ASTEROID ? (unsigned int)snapshot.current.size() - FIRST_ASTEROID : 0;
+	visibleCount += (unsigned int)visible.size();
+	culledCount += total - (unsigned int)visible.size();
+	unsigned int count = (unsigned int)visible.size();
+	instances.resize(count);
+	//a normal matrix each adds up once the belt's in the thousands, so the transforms go wide
+	auto transforms = [&snapshot, alpha, &visible, &instances](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			glm::mat4 model = glm::translate(glm::mat4(1.0f), snapshot.position(visible[i], alpha));
+			model = glm::scale(model, glm::vec3(0.01f));
+			instances.set(i, model);
+		}
+	};
+	if (count > 1024) {
+		jobs.parallelFor(count, 256, transforms);
+	} else {
+		transforms(0, count);
+	}
+	if (instances.count() == 0) {
+		return;
+	}
+	instances.upload();
+	objShader.use();
+	objShader.setInt(objShader.objectIdLoc, OUTLINE_NONE);
+	objModel.DrawInstanced(objShader, instances, instances.count());
+}
+
+//velocity for a circular orbit of radius |position| around centralMass at the origin, same way round as the old rotations
+glm::vec3 circularVelocity(glm::vec3 position, float centralMass) {
+	glm::vec3 axis = glm::vec3(0.f, earthSpeed < 0.f ? -1.f : 1.f, 0.f);
+	return glm::normalize(glm::cross(axis, position)) * sqrtf(centralMass / glm::length(position));
+}
+
+//the stars weigh whatever keeps the earth on its old 12 second year, the planets get roughly the real planet to sun
+//mass ratios since anything much heavier knocks the whole system apart within a few minutes
+//G is folded into the masses, so these are all G*m in scene units
+float starsMass() {
+	float earthRate = glm::radians(earthSpeed);
+	return earthRate * earthRate * powf(fabsf(earthDistance), 3.f);
+}
+
+void setupBodies(NBodySystem& bodies, int asteroids) {
+	bodies.clear();
+	float starsMass = ::starsMass();
+	//the barycenter sits at the origin, so each star's share goes with the other one's distance from it
+	float separation = glm::length(starStartPositions[1] - starStartPositions[0]);
+	float blueMass = starsMass * glm::length(starStartPositions[1]) / separation;
+	float orangeMass = starsMass - blueMass;
+	glm::vec3 binaryVelocity = circularVelocity(starStartPositions[1] - starStartPositions[0], starsMass);
+	bodies.addBody(starStartPositions[0], -binaryVelocity * orangeMass / starsMass, blueMass);
+	bodies.addBody(starStartPositions[1], binaryVelocity * blueMass / starsMass, orangeMass);
+
+	glm::vec3 earthPosition = glm::vec3(0.f, 0.f, earthDistance);
+	bodies.addBody(earthPosition, circularVelocity(earthPosition, starsMass), starsMass * 3e-6f);
+	glm::vec3 saturnPosition = glm::vec3(0.f, 0.f, saturnDistance);
+	bodies.addBody(saturnPosition, circularVelocity(saturnPosition, starsMass), starsMass * 3e-5f);
+	setAsteroidCount(bodies, asteroids);
+}
+
+//same numbers for the same index every time, so growing the belt keeps the asteroids already in it
+float beltRandom(unsigned int i, unsigned int salt) {
+	unsigned int h = i * 2654435761u ^ salt * 2246822519u;
+	h ^= h >> 15;
+	h *= 2246822519u;
+	h ^= h >> 13;
+	return (h & 0xFFFFFF) / 16777216.f;
+}
+
+//belt between 5.5 and 7.5 out, past saturn so it barely stirs it
+void setAsteroidCount(NBodySystem& bodies, int count) {
+	unsigned int current = bodies.count() - FIRST_ASTEROID;
+	if ((unsigned int)count <= current) {
+		bodies.truncate(FIRST_ASTEROID + count);
+		return;
+	}
+	float starsMass = ::starsMass();
+	for (unsigned int i = current; i < (unsigned int)count; i++) {
+		float radius = 5.5f + 2.f * beltRandom(i, 1);
+		float phase = 2.f * PI * beltRandom(i, 2);
+		glm::vec3 position = glm::vec3(radius * cosf(phase), 0.f, radius * sinf(phase));
+		glm::vec3 velocity = circularVelocity(position, starsMass);
+		position.y = 0.2f * (beltRandom(i, 3) - 0.5f);
+		bodies.addBody(position, velocity, starsMass * 1e-9f);
+	}
+}
+
+//star merger mode, drag on the stars' motion around each other, so the pair bleeds energy and spirals in tighter and faster
+void mergeStars(NBodySystem& bodies, float dt) {
+	if (glm::length(bodies.position(STAR_ORANGE_BODY) - bodies.position(STAR_BLUE_BODY)) < 0.25f) {
+		return;
+	}
+	float blueMass = bodies.mass(STAR_BLUE_BODY), orangeMass = bodies.mass(STAR_ORANGE_BODY);
+	glm::vec3 blue = bodies.velocity(STAR_BLUE_BODY), orange = bodies.velocity(STAR_ORANGE_BODY);
+	glm::vec3 center = (blue * blueMass + orange * orangeMass) / (blueMass + orangeMass);
+	float keep = 1.f - 0.3f * dt;
+	bodies.setVelocity(STAR_BLUE_BODY, center + (blue - center) * keep);
+	bodies.setVelocity(STAR_ORANGE_BODY, center + (orange - center) * keep);
+}
+
+//a wide, tilted, slightly eccentric ring of rocks between 9 and 14 out, seeded by index like the asteroid belt
+void setOuterBeltCount(KeplerOrbits& orbits, int count) {
+	if ((unsigned int)count <= orbits.count()) {
+		orbits.truncate(count);
+		return;
+	}
+	float starsMass = ::starsMass();
+	for (unsigned int i = orbits.count(); i < (unsigned int)count; i++) {
+		KeplerElements elements;
+		elements.semiMajorAxis = 9.f + 5.f * beltRandom(i, 4);
+		elements.eccentricity = 0.25f * beltRandom(i, 5);
+		elements.inclination = glm::radians(15.f) * beltRandom(i, 6);
+		elements.ascendingNode = 2.f * PI * beltRandom(i, 7);
+		elements.argumentOfPeriapsis = 2.f * PI * beltRandom(i, 8);
+		elements.meanAnomaly = 2.f * PI * beltRandom(i, 9);
+		//tumbling about a random axis at up to 3 radians a second, only the GPU path shows it
+		float z = 2.f * beltRandom(i, 11) - 1.f, phi = 2.f * PI * beltRandom(i, 12);
+		glm::vec3 axis = glm::vec3(sqrtf(1.f - z * z) * cosf(phi), z, sqrtf(1.f - z * z) * sinf(phi));
+		orbits.add(elements, starsMass, 0.004f + 0.008f * beltRandom(i, 10), axis * (0.5f + 2.5f * beltRandom(i, 13)), 2.f * PI * beltRandom(i, 14));
+	}
+}
+
+//positions come out of the propagator ready to go, one upload and one instanced draw
+//only what's in view gets uploaded, on the GPU path nothing's culled since the positions only ever exist in orbit.vs
+void drawOuterBelt(KeplerOrbits& orbits, ThreadPool& jobs, Shader& objShader, Model& objModel, PositionBuffer& positions) {
+	static vector<unsigned int> visible; //kept between frames so they stop allocating
+	static vector<glm::vec4> inView;
+	if (orbits.count() == 0) {
+		return;
+	}
+	visible.clear();
+	viewFrustum.cull(orbits.positions.data(), orbits.count(), objModel.bounds(), visible, &jobs);
+	visibleCount += (unsigned int)visible.size();
+	culledCount += orbits.count() - (unsigned int)visible.size();
+	inView.resize(visible.size());
+	for (unsigned int i = 0; i < visible.size(); i++) {
+		inView[i] = orbits.positions[visible[i]];
+	}
+	positions.upload(inView.data(), (unsigned int)inView.size());
+	objModel.DrawInstanced(objShader, positions, positions.count());
+}
+
+//the elements only go up when the belt changes size or the epoch gets old, every other frame is just the draw
+void drawOuterBeltGpu(KeplerOrbits& orbits, double time, Shader& objShader, UniformHandle timeLoc, Model& objModel, OrbitBuffer& elements) {
+	if (elements.stale(orbits, time)) {
+		elements.upload(orbits, time);
+	}
+	if (elements.count() == 0) {
+		return;
+	}
+	objShader.use();
+	objShader.setFloat(timeLoc, elements.timeSinceEpoch(time));
+	objModel.DrawInstanced(objShader, elements, elements.count());
+}
+
+void copyPositions(const NBodySystem& bodies, vector<glm::vec3>& positions) {
+	positions.resize(bodies.count());
+	for (unsigned int i = 0; i < bodies.count(); i++) {
+		positions[i] = bodies.position(i);
+	}
+}
+
+//the simulation thread, picks up the latest settings, runs whatever steps are due, publishes the batch and
+//sleeps until the next step, nothing in here ever waits on the render thread
+void simulationLoop(Simulation& simulation, ThreadPool& pool) {
+	SimClock& clock = simulation.clock;
+	NBodySystem& bodies = simulation.bodies;
+	SimSettings settings;
+	unsigned int resets = 0;
+	std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+	while (simulation.running) {
+		if (simulation.settings.update()) {
+			settings = simulation.settings.front();
+		}
+		clock.timeScale = settings.timeScale;
+		clock.paused = settings.paused;
+		bodies.barnesHut = settings.barnesHut;
+		bodies.openingAngle = settings.openingAngle;
+		if (settings.resets != resets) {
+			resets = settings.resets;
+			setupBodies(bodies, settings.asteroidCount);
+		}
+		if (settings.asteroidCount != (int)(bodies.count() - FIRST_ASTEROID)) {
+			setAsteroidCount(bodies, settings.asteroidCount);
+		}
+		bodies.setFrozen(EARTH_BODY, settings.stopEarth);
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		unsigned int steps = clock.advance(std::chrono::duration<double>(now - last).count());
+		last = now;
+		if (steps > 0) {
+			BodySnapshot& snapshot = simulation.snapshots.back();
+			copyPositions(bodies, snapshot.previous);
+			for (unsigned int i = 0; i < steps; i++) {
+				if (settings.mergeStars) {
+					mergeStars(bodies, (float)clock.stepSeconds);
+				}
+				bodies.step(&pool);
+			}
+			copyPositions(bodies, snapshot.current);
+			snapshot.tick = clock.tick();
+			snapshot.firstTick = snapshot.tick - steps;
+			snapshot.stepSeconds = clock.stepSeconds;
+			snapshot.span = steps * clock.stepSeconds / clock.timeScale;
+			snapshot.stepMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - now).count() / steps;
+			snapshot.treeNodes = bodies.barnesHut ? (unsigned int)bodies.tree().nodes.size() : 0;
+			snapshot.treeBuildMilliseconds = bodies.barnesHut ? bodies.tree().buildMilliseconds : 0.0;
+			snapshot.published = std::chrono::steady_clock::now();
+			simulation.snapshots.publish();
+		}
+		//till the next step is due, or a little while when nothing's moving so settings still get picked up
+		double wait = 0.005;
+		if (!clock.paused && clock.timeScale > 0.f) {
+			wait = std::min(wait, (1.0 - clock.alpha()) * clock.stepSeconds / clock.timeScale);
 		}
+		std::this_thread::sleep_for(std::chrono::duration<double>(wait));
 	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	return textureID;
 }
\ No newline at end of file
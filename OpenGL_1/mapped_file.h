@@ -0,0 +1,162 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+//read-only view of a whole file, the OS pages it in as we touch it instead of us copying it into a buffer
+class MappedFile {
+public:
+	MappedFile() {}
+	~MappedFile() {
+		close();
+	}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path) {
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) {
+			close();
+			return false;
+		}
+		view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (view == NULL) {
+			close();
+			return false;
+		}
+		length = (size_t)fileSize.QuadPart;
+#else
+		fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			close();
+			return false;
+		}
+		view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view == MAP_FAILED) {
+			view = NULL;
+			close();
+			return false;
+		}
+		length = (size_t)info.st_size;
+#endif
+		return true;
+	}
+	void close() {
+#ifdef _WIN32
+		if (view != NULL) {
+			UnmapViewOfFile(view);
+		}
+		if (mapping != NULL) {
+			CloseHandle(mapping);
+		}
+		if (file != INVALID_HANDLE_VALUE) {
+			CloseHandle(file);
+		}
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (view != NULL) {
+			munmap(view, length);
+		}
+		if (fd >= 0) {
+			::close(fd);
+		}
+		fd = -1;
+#endif
+		view = NULL;
+		length = 0;
+	}
+	const unsigned char* data() const {
+		return (const unsigned char*)view;
+	}
+	size_t size() const {
+		return length;
+	}
+	bool isOpen() const {
+		return view != NULL;
+	}
+private:
+	void* view = NULL;
+	size_t length = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#else
+	int fd = -1;
+#endif
+};
+
+//walks a mapped cache file in 4 byte aligned steps and refuses to read past the end, a cut off write just looks like a cache miss
+class MappedFileReader {
+public:
+	MappedFileReader(const unsigned char* data, size_t size) : data(data), size(size) {}
+	bool ok = true;
+
+	const unsigned char* take(size_t bytes) {
+		if (!ok || size - offset < bytes) {
+			ok = false;
+			return NULL;
+		}
+		const unsigned char* p = data + offset;
+		offset += (bytes + 3) & ~(size_t)3;
+		if (offset > size) {
+			offset = size;
+		}
+		return p;
+	}
+	uint32_t u32() {
+		const unsigned char* p = take(4);
+		uint32_t value = 0;
+		if (p) {
+			memcpy(&value, p, 4);
+		}
+		return value;
+	}
+	std::string str() {
+		uint32_t length = u32();
+		const unsigned char* p = take(length);
+		return p ? std::string((const char*)p, length) : std::string();
+	}
+	bool atEnd() const {
+		return offset == size;
+	}
+private:
+	const unsigned char* data;
+	size_t size;
+	size_t offset = 0;
+};
+
+#endif
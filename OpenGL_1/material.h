@@ -0,0 +1,89 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+#include "gl_state.h"
+
+#include <string>
+#include <vector>
+using namespace std;
+
+struct Texture {
+	unsigned int id;
+	string type;
+	string path;
+};
+
+//every sampler name maps to a fixed texture unit, so the sampler uniforms of a program
+//only have to be set once and drawing a material is nothing but texture binds
+//texture_diffuseN -> unit N-1, texture_specularN -> unit MAX_DIFFUSE_MAPS + N-1
+const unsigned int MAX_DIFFUSE_MAPS = 4;
+const unsigned int MAX_SPECULAR_MAPS = 4;
+
+//the textures one assimp material uses, shared by every mesh of the model that uses that material
+class Material {
+public:
+	vector<Texture> textures;
+	vector<unsigned int> units; //texture unit for each entry in textures
+
+	void addTexture(const Texture& texture) {
+		unsigned int unit;
+		if (texture.type == "texture_specular") {
+			if (specularCount >= MAX_SPECULAR_MAPS) {
+				cout << "WARNING::MATERIAL::TOO_MANY_SPECULAR_MAPS " << texture.path << endl;
+				return;
+			}
+			unit = MAX_DIFFUSE_MAPS + specularCount++;
+		} else {
+			if (diffuseCount >= MAX_DIFFUSE_MAPS) {
+				cout << "WARNING::MATERIAL::TOO_MANY_DIFFUSE_MAPS " << texture.path << endl;
+				return;
+			}
+			unit = diffuseCount++;
+		}
+		textures.push_back(texture);
+		units.push_back(unit);
+	}
+	//binds go through the state tracker, so a material drawn twice in a row costs nothing the second time
+	void bind() const {
+		for (unsigned int i = 0; i < textures.size(); i++) {
+			glState().bindTexture(units[i], GL_TEXTURE_2D, textures[i].id);
+		}
+	}
+
+	//for sort keys, materials that bind the same first texture end up next to each other
+	unsigned int sortId() const {
+		return textures.empty() ? 0 : textures[0].id;
+	}
+
+	//point every material sampler the program has at its fixed unit, once after linking
+	//"material.diffuse" is what light.fs calls its one diffuse map
+	static void assignSamplerUnits(Shader& shader) {
+		const string diffusePrefix = "material.texture_diffuse";
+		const string specularPrefix = "material.texture_specular";
+		shader.use();
+		for (unsigned int i = 0; i < shader.uniforms.size(); i++) {
+			const UniformInfo& uniform = shader.uniforms[i];
+			if (uniform.type != GL_SAMPLER_2D) {
+				continue;
+			}
+			UniformHandle h = { uniform.location };
+			if (uniform.name == "material.diffuse") {
+				shader.setInt(h, 0);
+			} else if (uniform.name.compare(0, diffusePrefix.size(), diffusePrefix) == 0) {
+				unsigned int n = (unsigned int)stoi(uniform.name.substr(diffusePrefix.size()));
+				shader.setInt(h, n - 1);
+			} else if (uniform.name.compare(0, specularPrefix.size(), specularPrefix) == 0) {
+				unsigned int n = (unsigned int)stoi(uniform.name.substr(specularPrefix.size()));
+				shader.setInt(h, MAX_DIFFUSE_MAPS + n - 1);
+			}
+		}
+	}
+private:
+	unsigned int diffuseCount = 0;
+	unsigned int specularCount = 0;
+};
+
+#endif
@@ -7,81 +7,45 @@
 #include "glm/gtc/matrix_transform.hpp"
 
 #include "shader.h"
+#include "material.h"
+#include "gl_state.h"
+#include "instance_buffer.h"
+#include "geometry_arena.h"
 
 #include <string>
 #include <vector>
 using namespace std;
 
-struct Vertex {
-	glm::vec3 Position;
-	glm::vec3 Normal;
-	glm::vec2 TexCoords;
-};
-struct Texture {
-	unsigned int id;
-	string type;
-	string path;
-};
+//one mesh's slice of the shared geometry arena and the material it's drawn with
 class Mesh {
 	public:
-		// mesh data
-		vector<Vertex> vertices;
-		vector<unsigned int> indices;
-		vector<Texture> textures;
-		Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures) {
-			this->vertices = vertices;
-			this->indices = indices;
-			this->textures = textures;
-			setupMesh();
+		// mesh data, the vertex and index arrays only live on the GPU
+		unsigned int vertexCount;
+		unsigned int indexCount;
+		unsigned int materialIndex; //into the owning Model's materials
+		GeometryRange range;
+		//the arrays are only read during the upload, they can come straight out of a mapped cache file
+		//vertices are Vertex or CompactVertex depending on format, and go in that format's arena, indexSize is 2 or 4 bytes
+		Mesh(VertexFormat format, const void* vertices, unsigned int vertexCount, const void* indices, unsigned int indexCount, unsigned int indexSize,
+			unsigned int materialIndex) {
+			this->vertexCount = vertexCount;
+			this->indexCount = indexCount;
+			this->materialIndex = materialIndex;
+			range = geometryArena(format).add(vertices, vertexCount, indices, indexCount, indexSize);
 		}
-		void Draw(Shader& shader) {
-			unsigned int diffuseNr = 1;
-			unsigned int specularNr = 1;
-			for (unsigned int i = 0; i < textures.size(); i++) {
-				glActiveTexture(GL_TEXTURE0 + i); // activate texture unit first
-				// retrieve texture number (the N in diffuse_textureN)
-				string number;
-				string name = textures[i].type;
-				if (name == "texture_diffuse")
-					number = std::to_string(diffuseNr++);
-				else if (name == "texture_specular")
-					number = std::to_string(specularNr++);
-				shader.setInt(("material." + name + number).c_str(), i);
-				glBindTexture(GL_TEXTURE_2D, textures[i].id);
-			}
-			glActiveTexture(GL_TEXTURE0);
-			//draw mesh
-			glBindVertexArray(VAO);
-			glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-			glBindVertexArray(0);
+		//sampler units were assigned once at load, so drawing is just binds the tracker hasn't already got
+		//every mesh shares the arena's VAO, after the first draw of a frame that bind is always skipped
+		void Draw(const Material& material) {
+			material.bind();
+			geometryArena(range.format).bind();
+			glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, range.indexType, range.indexOffset(), range.baseVertex);
 		}
-	private:
-		// render data
-		unsigned int VAO, VBO, EBO;
-		void setupMesh() {
-			glGenVertexArrays(1, &VAO);
-			glGenBuffers(1, &VBO);
-			glGenBuffers(1, &EBO);
-			glBindVertexArray(VAO);
-			glBindBuffer(GL_ARRAY_BUFFER, VBO);
-			glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-			// vertex positions
-			glEnableVertexAttribArray(0);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-
-			// vertex normals
-			glEnableVertexAttribArray(1);
-			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-				(void*)offsetof(Vertex, Normal));
-
-			// vertex texture coords
-			glEnableVertexAttribArray(2);
-			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-
-			glBindVertexArray(0);
+		//one call for every instance
+		template <class Buffer>
+		void DrawInstanced(const Material& material, const Buffer& instances, unsigned int count) {
+			material.bind();
+			geometryArena(range.format).bindInstances(instances);
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, range.indexType, range.indexOffset(), count, range.baseVertex);
 		}
 };
 
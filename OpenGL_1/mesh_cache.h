@@ -0,0 +1,231 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "mesh.h"
+#include "bounds.h"
+#include "mapped_file.h"
+#include "image.h"
+#include "hash.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <map>
+#include <vector>
+using namespace std;
+
+//bump this whenever Vertex or the file layout below changes, old caches just get rebuilt
+const uint32_t MESH_CACHE_MAGIC = 0x4843534D; // "MSCH"
+const uint32_t MESH_CACHE_VERSION = 2; //2: meshes optimised at import, 16 bit indices
+static_assert(sizeof(Vertex) == 32, "Vertex layout changed, bump MESH_CACHE_VERSION");
+
+//one mesh ready to go to the GPU, the arrays either live in ModelData's vectors or in the mapped cache file
+struct MeshView {
+	const Vertex* vertices;
+	uint32_t vertexCount;
+	const void* indices; //uint16_t or unsigned int going by indexSize
+	uint32_t indexCount;
+	uint32_t indexSize;
+	uint32_t materialIndex;
+};
+struct TextureRef {
+	string type;
+	string path; //relative to the model's directory, as written in the .mtl
+};
+struct MaterialData {
+	vector<TextureRef> textures;
+};
+
+//everything a Model needs out of an import, without touching GL, so it can be built on any thread
+struct ModelData {
+	string directory;
+	vector<MeshView> meshes;
+	vector<MaterialData> materials;
+	map<string, TextureInfo> textureInfo; //hash and size of the textures of the materials in use, keyed by TextureRef::path
+	map<string, Image> images; //decoded textures of the materials in use, same keys, only if asked for
+	bool fromCache = false;
+	Bounds bounds; //of every mesh together, filled in by loadCpu whichever way the meshes came
+	double cpuMilliseconds = 0.0; //import/map plus texture decode
+	//backing storage for a fresh import
+	vector<vector<Vertex>> vertexStorage;
+	vector<vector<unsigned int>> indexStorage;
+	vector<vector<uint16_t>> shortIndexStorage; //what the views point at instead for meshes under 65536 vertices
+	//backing storage for a warm start
+	MappedFile cacheFile;
+	//only when loadCpu was asked for compact vertices, one array per mesh and what upload() sends instead of the views'
+	//the cache itself always holds full Vertex, packing is cheap next to the import
+	VertexFormat format = VERTEX_FULL;
+	VertexDecode decode;
+	vector<vector<CompactVertex>> compactStorage;
+};
+
+//cache lives next to the source, models\earth\earth.obj -> models\earth\earth.meshcache
+inline string meshCachePath(const string& path) {
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("\\/");
+	if (dot == string::npos || (slash != string::npos && dot < slash)) {
+		return path + ".meshcache";
+	}
+	return path.substr(0, dot) + ".meshcache";
+}
+
+//hash of the .obj plus every .mtl it pulls in, since the texture paths come from there
+inline uint64_t hashModelSource(const string& path, const string& directory) {
+	ifstream file(path, ios::binary);
+	if (!file) {
+		return 0;
+	}
+	stringstream buffer;
+	buffer << file.rdbuf();
+	string source = buffer.str();
+	uint64_t hash = fnv1a(source.data(), source.size());
+
+	istringstream lines(source);
+	string line;
+	while (getline(lines, line)) {
+		if (line.compare(0, 7, "mtllib ") != 0) {
+			continue;
+		}
+		string mtlName = line.substr(7);
+		while (!mtlName.empty() && (mtlName.back() == '\r' || mtlName.back() == ' ')) {
+			mtlName.pop_back();
+		}
+		ifstream mtl(directory + '/' + mtlName, ios::binary);
+		if (mtl) {
+			stringstream mtlBuffer;
+			mtlBuffer << mtl.rdbuf();
+			string mtlSource = mtlBuffer.str();
+			hash = fnv1a(mtlSource.data(), mtlSource.size(), hash);
+		}
+	}
+	return hash;
+}
+
+/* file layout, every field is 4 byte aligned so the vertex and index arrays can be used straight out of the mapping
+ *   header   magic, version, import flags, mesh count, material count, padding, source hash (u64)
+ *   per material   texture count, then per texture: type length, type (padded to 4), path length, path (padded to 4)
+ *   per mesh       material index, vertex count, index count, index size, Vertex[vertex count], u16 or u32[index count] (padded to 4)
+ */
+struct MeshCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t importFlags;
+	uint32_t meshCount;
+	uint32_t materialCount;
+	uint32_t padding;
+	uint64_t sourceHash;
+};
+
+//every index below the mesh's vertex count, read as whatever size the view says they are
+inline bool indicesInRange(const MeshView& view) {
+	for (uint32_t i = 0; i < view.indexCount; i++) {
+		uint32_t index = view.indexSize == 2 ? ((const uint16_t*)view.indices)[i] : ((const uint32_t*)view.indices)[i];
+		if (index >= view.vertexCount) {
+			return false;
+		}
+	}
+	return true;
+}
+
+inline bool readMeshCache(const string& cachePath, uint64_t sourceHash, uint32_t importFlags, ModelData& out) {
+	if (!out.cacheFile.open(cachePath)) {
+		return false;
+	}
+	MappedFileReader reader(out.cacheFile.data(), out.cacheFile.size());
+	const unsigned char* headerBytes = reader.take(sizeof(MeshCacheHeader));
+	if (!headerBytes) {
+		out.cacheFile.close();
+		return false;
+	}
+	MeshCacheHeader header;
+	memcpy(&header, headerBytes, sizeof(header));
+	if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION ||
+		header.importFlags != importFlags || header.sourceHash != sourceHash) {
+		out.cacheFile.close();
+		return false;
+	}
+
+	vector<MaterialData> materials(header.materialCount);
+	for (uint32_t m = 0; m < header.materialCount && reader.ok; m++) {
+		uint32_t textureCount = reader.u32();
+		for (uint32_t t = 0; t < textureCount && reader.ok; t++) {
+			TextureRef ref;
+			ref.type = reader.str();
+			ref.path = reader.str();
+			materials[m].textures.push_back(ref);
+		}
+	}
+	vector<MeshView> meshes(header.meshCount);
+	for (uint32_t i = 0; i < header.meshCount && reader.ok; i++) {
+		MeshView& view = meshes[i];
+		view.materialIndex = reader.u32();
+		view.vertexCount = reader.u32();
+		view.indexCount = reader.u32();
+		view.indexSize = reader.u32();
+		view.vertices = (const Vertex*)reader.take((size_t)view.vertexCount * sizeof(Vertex));
+		view.indices = reader.take((size_t)view.indexCount * view.indexSize);
+		if (view.materialIndex >= header.materialCount || (view.indexSize != 2 && view.indexSize != 4)) {
+			reader.ok = false;
+		}
+		//an index past the mesh's own vertices would read some other mesh's out of the shared arena
+		if (reader.ok && !indicesInRange(view)) {
+			reader.ok = false;
+		}
+	}
+	if (!reader.ok || !reader.atEnd()) {
+		cout << "WARNING::MESH_CACHE::CORRUPT " << cachePath << endl;
+		out.cacheFile.close();
+		return false;
+	}
+	out.meshes = meshes;
+	out.materials = materials;
+	out.fromCache = true;
+	return true;
+}
+
+inline void writeMeshCache(const string& cachePath, uint64_t sourceHash, uint32_t importFlags, const ModelData& data) {
+	ofstream file(cachePath, ios::binary | ios::trunc);
+	if (!file) {
+		cout << "WARNING::MESH_CACHE::CANNOT_WRITE " << cachePath << endl;
+		return;
+	}
+	const char zeros[4] = { 0, 0, 0, 0 };
+	auto writeU32 = [&file](uint32_t value) {
+		file.write((const char*)&value, 4);
+	};
+	auto writeStr = [&](const string& value) {
+		writeU32((uint32_t)value.size());
+		file.write(value.data(), value.size());
+		file.write(zeros, (4 - value.size() % 4) % 4);
+	};
+
+	MeshCacheHeader header = { MESH_CACHE_MAGIC, MESH_CACHE_VERSION, importFlags,
+		(uint32_t)data.meshes.size(), (uint32_t)data.materials.size(), 0, sourceHash };
+	file.write((const char*)&header, sizeof(header));
+	for (unsigned int m = 0; m < data.materials.size(); m++) {
+		writeU32((uint32_t)data.materials[m].textures.size());
+		for (unsigned int t = 0; t < data.materials[m].textures.size(); t++) {
+			writeStr(data.materials[m].textures[t].type);
+			writeStr(data.materials[m].textures[t].path);
+		}
+	}
+	for (unsigned int i = 0; i < data.meshes.size(); i++) {
+		const MeshView& view = data.meshes[i];
+		writeU32(view.materialIndex);
+		writeU32(view.vertexCount);
+		writeU32(view.indexCount);
+		writeU32(view.indexSize);
+		file.write((const char*)view.vertices, (size_t)view.vertexCount * sizeof(Vertex));
+		size_t indexBytes = (size_t)view.indexCount * view.indexSize;
+		file.write((const char*)view.indices, indexBytes);
+		file.write(zeros, (4 - indexBytes % 4) % 4);
+	}
+	if (!file) {
+		cout << "WARNING::MESH_CACHE::CANNOT_WRITE " << cachePath << endl;
+	}
+}
+
+#endif
@@ -0,0 +1,257 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include "glm/glm.hpp"
+
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+//entries in the post-transform cache the reordering aims for and ACMR is measured against, real GPUs
+//don't have a plain FIFO any more but it still tracks how often a vertex gets shaded twice
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+//what the import pass did to one mesh, ACMR is vertex shader runs per triangle, 0.5 is the best a big grid can do, 3 the worst
+struct MeshOptimizeReport {
+	unsigned int verticesBefore = 0;
+	unsigned int verticesAfter = 0;
+	float acmrBefore = 0.f;
+	float acmrAfter = 0.f;
+};
+
+namespace MeshOptimizer {
+	//runs indices through a FIFO of cacheSize and counts the misses per triangle
+	inline float acmr(const vector<unsigned int>& indices, unsigned int vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE) {
+		if (indices.size() < 3) {
+			return 0.f;
+		}
+		//a vertex is in the cache if it went in less than cacheSize misses ago
+		vector<unsigned int> insertedAt(vertexCount, 0);
+		unsigned int misses = 0;
+		for (unsigned int i = 0; i < indices.size(); i++) {
+			unsigned int v = indices[i];
+			if (insertedAt[v] == 0 || misses - insertedAt[v] >= cacheSize) {
+				misses++;
+				insertedAt[v] = misses;
+			}
+		}
+		return (float)misses / (indices.size() / 3);
+	}
+
+	//obj faces each bring their own copy of every corner, the ones identical to the bit collapse into one
+	inline void weld(vector<Vertex>& vertices, vector<unsigned int>& indices) {
+		struct Hash {
+			size_t operator()(const Vertex& v) const {
+				uint64_t hash = 14695981039346656037ull;
+				const unsigned char* bytes = (const unsigned char*)&v;
+				for (unsigned int i = 0; i < sizeof(Vertex); i++) {
+					hash = (hash ^ bytes[i]) * 1099511628211ull;
+				}
+				return (size_t)hash;
+			}
+		};
+		struct Equal {
+			bool operator()(const Vertex& a, const Vertex& b) const {
+				return memcmp(&a, &b, sizeof(Vertex)) == 0;
+			}
+		};
+		unordered_map<Vertex, unsigned int, Hash, Equal> seen;
+		seen.reserve(vertices.size());
+		vector<unsigned int> remap(vertices.size());
+		vector<Vertex> unique;
+		unique.reserve(vertices.size());
+		for (unsigned int i = 0; i < vertices.size(); i++) {
+			auto inserted = seen.emplace(vertices[i], (unsigned int)unique.size());
+			if (inserted.second) {
+				unique.push_back(vertices[i]);
+			}
+			remap[i] = inserted.first->second;
+		}
+		for (unsigned int i = 0; i < indices.size(); i++) {
+			indices[i] = remap[indices[i]];
+		}
+		vertices.swap(unique);
+	}
+
+	//Tipsify (Sander, Nehab and Barczak 2007), fans out around one vertex at a time and picks the next one
+	//still in the cache with the most triangles left, so every vertex gets used up while it's cached
+	//clusterStarts gets where the walk hit a dead end and had to jump, nothing cached carries over there
+	inline void tipsify(vector<unsigned int>& indices, unsigned int vertexCount, vector<unsigned int>& clusterStarts,
+		unsigned int cacheSize = VERTEX_CACHE_SIZE) {
+		unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+		//triangles around each vertex, counted then filled in
+		vector<unsigned int> live(vertexCount, 0);
+		for (unsigned int i = 0; i < indices.size(); i++) {
+			live[indices[i]]++;
+		}
+		vector<unsigned int> offsets(vertexCount + 1, 0);
+		for (unsigned int v = 0; v < vertexCount; v++) {
+			offsets[v + 1] = offsets[v] + live[v];
+		}
+		vector<unsigned int> adjacency(indices.size());
+		vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (unsigned int i = 0; i < indices.size(); i++) {
+			adjacency[fill[indices[i]]++] = i / 3;
+		}
+
+		vector<unsigned int> cachedAt(vertexCount, 0); //timestamp a vertex went into the cache
+		vector<bool> emitted(triangleCount, false);
+		vector<unsigned int> deadEnds; //vertices recently touched, where to look when a fan runs out
+		vector<unsigned int> candidates;
+		vector<unsigned int> out;
+		out.reserve(indices.size());
+		clusterStarts.clear();
+		unsigned int time = cacheSize + 1;
+		unsigned int cursor = 0; //everything before it has no triangles left
+		int fanning = 0;
+		bool jumped = true;
+		while (fanning >= 0) {
+			if (jumped) {
+				clusterStarts.push_back((unsigned int)(out.size() / 3));
+				jumped = false;
+			}
+			candidates.clear();
+			for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+				unsigned int t = adjacency[a];
+				if (emitted[t]) {
+					continue;
+				}
+				emitted[t] = true;
+				for (unsigned int c = 0; c < 3; c++) {
+					unsigned int v = indices[t * 3 + c];
+					out.push_back(v);
+					deadEnds.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - cachedAt[v] > cacheSize) {
+						cachedAt[v] = time++;
+					}
+				}
+			}
+			//the candidate still cached after its own fan goes in, with the most left to do
+			int next = -1;
+			unsigned int best = 0;
+			for (unsigned int i = 0; i < candidates.size(); i++) {
+				unsigned int v = candidates[i];
+				if (live[v] == 0) {
+					continue;
+				}
+				unsigned int priority = 0;
+				if (time - cachedAt[v] + 2 * live[v] <= cacheSize) {
+					priority = time - cachedAt[v];
+				}
+				if (next < 0 || priority > best) {
+					best = priority;
+					next = (int)v;
+				}
+			}
+			if (next < 0) {
+				while (!deadEnds.empty() && next < 0) {
+					unsigned int v = deadEnds.back();
+					deadEnds.pop_back();
+					if (live[v] > 0) {
+						next = (int)v;
+					}
+				}
+				while (next < 0 && cursor < vertexCount) {
+					if (live[cursor] > 0) {
+						next = (int)cursor;
+					}
+					cursor++;
+				}
+				jumped = true;
+			}
+			fanning = next;
+		}
+		indices.swap(out);
+	}
+
+	//Tipsify's overdraw half, clusters facing out from the middle of the mesh go first so they hide the rest
+	//from early-z whichever side it's seen from
+	inline void sortClusters(const vector<Vertex>& vertices, vector<unsigned int>& indices, const vector<unsigned int>& clusterStarts) {
+		unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+		if (clusterStarts.size() < 2) {
+			return;
+		}
+		glm::vec3 meshCenter(0.f);
+		for (unsigned int i = 0; i < indices.size(); i++) {
+			meshCenter += vertices[indices[i]].Position;
+		}
+		meshCenter /= (float)indices.size();
+		struct Cluster {
+			unsigned int first, end;
+			float occlusion;
+		};
+		vector<Cluster> clusters(clusterStarts.size());
+		for (unsigned int c = 0; c < clusterStarts.size(); c++) {
+			Cluster& cluster = clusters[c];
+			cluster.first = clusterStarts[c];
+			cluster.end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+			glm::vec3 center(0.f), normal(0.f);
+			float areaSum = 0.f;
+			for (unsigned int t = cluster.first; t < cluster.end; t++) {
+				glm::vec3 a = vertices[indices[t * 3]].Position;
+				glm::vec3 b = vertices[indices[t * 3 + 1]].Position;
+				glm::vec3 c2 = vertices[indices[t * 3 + 2]].Position;
+				glm::vec3 area = glm::cross(b - a, c2 - a); //length is twice the area, so big triangles count for more
+				center += (a + b + c2) * (glm::length(area) / 3.f);
+				areaSum += glm::length(area);
+				normal += area;
+			}
+			float length = glm::length(normal);
+			cluster.occlusion = areaSum > 0.f && length > 0.f ? glm::dot(center / areaSum - meshCenter, normal / length) : 0.f;
+		}
+		stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+			return a.occlusion > b.occlusion;
+		});
+		vector<unsigned int> out;
+		out.reserve(indices.size());
+		for (unsigned int c = 0; c < clusters.size(); c++) {
+			out.insert(out.end(), indices.begin() + clusters[c].first * 3, indices.begin() + clusters[c].end * 3);
+		}
+		indices.swap(out);
+	}
+
+	//vertices renumbered in the order the triangles first use them, so fetches walk the buffer front to back
+	//anything no triangle uses is dropped
+	inline void reorderVertices(vector<Vertex>& vertices, vector<unsigned int>& indices) {
+		const unsigned int unused = 0xFFFFFFFFu;
+		vector<unsigned int> remap(vertices.size(), unused);
+		vector<Vertex> out;
+		out.reserve(vertices.size());
+		for (unsigned int i = 0; i < indices.size(); i++) {
+			unsigned int& slot = remap[indices[i]];
+			if (slot == unused) {
+				slot = (unsigned int)out.size();
+				out.push_back(vertices[indices[i]]);
+			}
+			indices[i] = slot;
+		}
+		vertices.swap(out);
+	}
+
+	//the whole import pass, triangles only, anything else is left exactly as it came
+	inline MeshOptimizeReport optimize(vector<Vertex>& vertices, vector<unsigned int>& indices) {
+		MeshOptimizeReport report;
+		report.verticesBefore = report.verticesAfter = (unsigned int)vertices.size();
+		report.acmrBefore = report.acmrAfter = acmr(indices, (unsigned int)vertices.size());
+		if (indices.empty() || indices.size() % 3 != 0) {
+			return report;
+		}
+		weld(vertices, indices);
+		vector<unsigned int> clusterStarts;
+		tipsify(indices, (unsigned int)vertices.size(), clusterStarts);
+		sortClusters(vertices, indices, clusterStarts);
+		reorderVertices(vertices, indices);
+		report.verticesAfter = (unsigned int)vertices.size();
+		report.acmrAfter = acmr(indices, (unsigned int)vertices.size());
+		return report;
+	}
+}
+
+#endif
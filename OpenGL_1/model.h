@@ -11,7 +11,17 @@
 #include <assimp/postprocess.h>
 
 #include "mesh.h"
+#include "draw_batch.h"
+#include "bounds.h"
+#include "material.h"
 #include "shader.h"
+#include "gl_state.h"
+#include "instance_buffer.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "image.h"
+#include "texture_streamer.h"
+#include "texture_registry.h"
 
 #include <string>
 #include <fstream>
@@ -19,72 +29,276 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 using namespace std;
 
+//flags the importer runs with, part of the mesh cache key so changing them invalidates old caches
+const unsigned int IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs;
+
 class Model {
 	public:
+		bool loadedFromCache = false;
+		bool transparent = false; //blended, and drawn back to front after everything opaque
+		double loadMilliseconds = 0.0;
+		//empty until upload(), for models that load in the background
+		Model() {}
 		Model(char* path) {
-			loadModel(path);
+			shared_ptr<ModelData> data = loadCpu(path);
+			if (data) {
+				upload(*data);
+			}
+		}
+		//GL thread only, gives the model's textures back to the registry
+		void destroy() {
+			for (unsigned int i = 0; i < textures_loaded.size(); i++) {
+				textureRegistry().release(textures_loaded[i].id);
+			}
+			textures_loaded.clear();
 		}
 		void Draw(Shader& shader) {
+			shader.use();
+			shader.setVertexDecode(decode.offset, decode.scale, decode.octNormals);
+			for (unsigned int i = 0; i < meshes.size(); i++) {
+				meshes[i].Draw(materials[meshes[i].materialIndex]);
+			}
+		}
+		//draws count copies in one call per mesh, shader has to read its transforms from the instance attributes
+		template <class Buffer>
+		void DrawInstanced(Shader& shader, const Buffer& instances, unsigned int count) {
+			if (count == 0) {
+				return;
+			}
+			shader.use();
+			shader.setVertexDecode(decode.offset, decode.scale, decode.octNormals);
 			for (unsigned int i = 0; i < meshes.size(); i++) {
-				meshes[i].Draw(shader);
+				meshes[i].DrawInstanced(materials[meshes[i].materialIndex], instances, count);
+			}
+		}
+		//queues every mesh into batch instead of drawing it, shader has to take its transforms per instance
+		void DrawBatched(DrawBatch& batch, Shader& shader, const glm::mat4& model, int outlineId) {
+			if (meshes.empty()) {
+				return;
+			}
+			unsigned int transform = batch.addTransform(model);
+			float distance = batch.distance(model);
+			for (unsigned int i = 0; i < meshes.size(); i++) {
+				const Material& material = materials[meshes[i].materialIndex];
+				uint64_t key = transparent ? RenderKey::transparent(shader.ID, material.sortId(), outlineId, distance)
+					: RenderKey::opaque(shader.ID, material.sortId(), outlineId, distance);
+				batch.add(key, shader, material, decode, meshes[i].range, transform, outlineId);
+			}
+		}
+		//everything that doesn't need GL: mesh cache or assimp, then hashing (and maybe decoding) every texture in use
+		//safe to run on a worker thread, the result goes to upload() on the GL thread
+		//warm starts map the .meshcache next to the model and skip assimp entirely
+		//leave decodeImages off when upload() gets a streamer, it decodes them itself
+		//VERTEX_COMPACT packs the vertices down to half the size for the GPU, see vertex_format.h
+		static shared_ptr<ModelData> loadCpu(const string& path, bool decodeImages = true, VertexFormat format = VERTEX_FULL) {
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			shared_ptr<ModelData> data = make_shared<ModelData>();
+			data->directory = path.substr(0, path.find_last_of('\\'));
+			string cachePath = meshCachePath(path);
+			uint64_t sourceHash = hashModelSource(path, data->directory);
+			if (!readMeshCache(cachePath, sourceHash, IMPORT_FLAGS, *data)) {
+				if (!importModel(path, *data)) {
+					return nullptr;
+				}
+				writeMeshCache(cachePath, sourceHash, IMPORT_FLAGS, *data);
+			}
+			data->bounds = computeBounds(*data);
+			if (format == VERTEX_COMPACT) {
+				compactMeshes(path, *data);
+			}
+			vector<bool> used = usedMaterials(*data);
+			for (unsigned int m = 0; m < data->materials.size(); m++) {
+				for (unsigned int t = 0; used[m] && t < data->materials[m].textures.size(); t++) {
+					const string& texturePath = data->materials[m].textures[t].path;
+					if (data->textureInfo.count(texturePath) != 0) {
+						continue;
+					}
+					//the content hash lets the registry spot the same image under another name
+					vector<unsigned char> bytes;
+					readFileBytes(data->directory + '/' + texturePath, bytes);
+					data->textureInfo[texturePath] = inspectImage(bytes);
+					if (decodeImages) {
+						data->images[texturePath] = decodeImage(bytes);
+					}
+				}
+			}
+			data->cpuMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			return data;
+		}
+		//everything GL happens here, for both a fresh import and a mapped cache
+		//with a streamer, textures start out as placeholders and sharpen over the next frames
+		void upload(const ModelData& data, TextureStreamer* streamer = NULL) {
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			directory = data.directory;
+			loadedFromCache = data.fromCache;
+			modelBounds = data.bounds;
+			decode = data.decode;
+			// only materials a mesh actually uses get their textures loaded
+			vector<bool> used = usedMaterials(data);
+			materials.resize(data.materials.size());
+			for (unsigned int m = 0; m < data.materials.size(); m++) {
+				if (!used[m]) {
+					continue;
+				}
+				for (unsigned int t = 0; t < data.materials[m].textures.size(); t++) {
+					materials[m].addTexture(loadTexture(data, data.materials[m].textures[t], streamer));
+				}
 			}
+			meshes.reserve(data.meshes.size());
+			for (unsigned int i = 0; i < data.meshes.size(); i++) {
+				const MeshView& view = data.meshes[i];
+				const void* vertices = data.format == VERTEX_COMPACT ? (const void*)data.compactStorage[i].data() : (const void*)view.vertices;
+				meshes.push_back(Mesh(data.format, vertices, view.vertexCount, view.indices, view.indexCount, view.indexSize, view.materialIndex));
+			}
+			loadMilliseconds = data.cpuMilliseconds + chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		}
+		//model space, all zero until upload() has run
+		const Bounds& bounds() const {
+			return modelBounds;
 		}
 	private:
 		// model data
 		vector<Mesh> meshes;
-		vector<Texture> textures_loaded;
+		Bounds modelBounds;
+		VertexDecode decode; //identity unless the vertices are compact
+		vector<Material> materials; //one per assimp material, meshes point into it by index
+		vector<Texture> textures_loaded; //every texture this model holds a registry reference on
 		string directory;
-		void loadModel(string path) {
+		//box over every vertex, then the sphere around the box's middle out to the furthest one
+		static Bounds computeBounds(const ModelData& data) {
+			Bounds bounds;
+			bool first = true;
+			for (unsigned int m = 0; m < data.meshes.size(); m++) {
+				const MeshView& view = data.meshes[m];
+				for (unsigned int i = 0; i < view.vertexCount; i++) {
+					const glm::vec3& p = view.vertices[i].Position;
+					bounds.min = first ? p : glm::min(bounds.min, p);
+					bounds.max = first ? p : glm::max(bounds.max, p);
+					first = false;
+				}
+			}
+			bounds.center = (bounds.min + bounds.max) * 0.5f;
+			float radius2 = 0.f;
+			for (unsigned int m = 0; m < data.meshes.size(); m++) {
+				const MeshView& view = data.meshes[m];
+				for (unsigned int i = 0; i < view.vertexCount; i++) {
+					glm::vec3 d = view.vertices[i].Position - bounds.center;
+					radius2 = glm::max(radius2, glm::dot(d, d));
+				}
+			}
+			bounds.radius = sqrtf(radius2);
+			return bounds;
+		}
+		//every mesh packed against the model's box rather than its own, so one decode covers every draw of the model
+		//and the batch can keep grouping by material, the worst error goes to the console
+		static void compactMeshes(const string& path, ModelData& data) {
+			CompactReport report;
+			size_t vertexCount = 0;
+			data.compactStorage.resize(data.meshes.size());
+			for (unsigned int i = 0; i < data.meshes.size(); i++) {
+				const MeshView& view = data.meshes[i];
+				compactVertices(view.vertices, view.vertexCount, data.bounds.min, data.bounds.max, data.compactStorage[i], report);
+				vertexCount += view.vertexCount;
+			}
+			data.format = VERTEX_COMPACT;
+			data.decode.offset = data.bounds.min;
+			data.decode.scale = data.bounds.max - data.bounds.min;
+			data.decode.octNormals = true;
+			float size = glm::length(data.decode.scale);
+			cout << "Compact vertices for " << path << ": " << vertexCount * sizeof(Vertex) / 1024 << " KB -> "
+				<< vertexCount * sizeof(CompactVertex) / 1024 << " KB, max error position " << report.position
+				<< " (" << (size > 0.f ? report.position / size * 100.f : 0.f) << "% of the box), normal "
+				<< report.normalDegrees << " deg, uv " << report.texCoord << endl;
+		}
+		static vector<bool> usedMaterials(const ModelData& data) {
+			vector<bool> used(data.materials.size(), false);
+			for (unsigned int i = 0; i < data.meshes.size(); i++) {
+				used[data.meshes[i].materialIndex] = true;
+			}
+			return used;
+		}
+		static bool importModel(const string& path, ModelData& data) {
 			Assimp::Importer import;
-			const aiScene * scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+			const aiScene * scene = import.ReadFile(path, IMPORT_FLAGS);
 			if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
 				cout << "ERROR::ASSIMP::" << import.GetErrorString() << endl;
-				return;
+				return false;
+			}
+			data.materials.resize(scene->mNumMaterials);
+			for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+				collectMaterialTextures(scene->mMaterials[i], aiTextureType_DIFFUSE, "texture_diffuse", data.materials[i]);
+				collectMaterialTextures(scene->mMaterials[i], aiTextureType_SPECULAR, "texture_specular", data.materials[i]);
 			}
-			directory = path.substr(0, path.find_last_of('\\'));
-			processNode(scene->mRootNode, scene);
+			processNode(scene->mRootNode, scene, data);
+			optimizeMeshes(path, data);
+			//the views are filled last, once the storage vectors have stopped moving around
+			for (unsigned int i = 0; i < data.meshes.size(); i++) {
+				data.meshes[i].vertices = data.vertexStorage[i].data();
+				if (data.meshes[i].indexSize == 2) {
+					data.meshes[i].indices = data.shortIndexStorage[i].data();
+				} else {
+					data.meshes[i].indices = data.indexStorage[i].data();
+				}
+			}
+			return true;
 		}
-		void processNode(aiNode* node, const aiScene* scene)
+		static void processNode(aiNode* node, const aiScene* scene, ModelData& data)
 		{
 			// process all the nodes meshes (if any)
 			for (unsigned int i = 0; i < node->mNumMeshes; i++)
 			{
 				aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-				meshes.push_back(processMesh(mesh, scene));
+				processMesh(mesh, data);
 			}
 			// then do the same for each of its children
 			for (unsigned int i = 0; i < node->mNumChildren; i++)
 			{
-				processNode(node->mChildren[i], scene);
+				processNode(node->mChildren[i], scene, data);
 			}
 		}
-		Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+		//assimp hands faces over in file order with every corner its own vertex, that's welded, reordered for
+		//the vertex cache and renumbered for fetch order here, once, and the mesh cache keeps the result
+		//meshes that fit get their indices halved to 16 bit
+		static void optimizeMeshes(const string& path, ModelData& data) {
+			data.shortIndexStorage.resize(data.meshes.size());
+			for (unsigned int i = 0; i < data.meshes.size(); i++) {
+				vector<Vertex>& vertices = data.vertexStorage[i];
+				vector<unsigned int>& indices = data.indexStorage[i];
+				MeshOptimizeReport report = MeshOptimizer::optimize(vertices, indices);
+				MeshView& view = data.meshes[i];
+				view.vertexCount = (uint32_t)vertices.size();
+				view.indexCount = (uint32_t)indices.size();
+				if (vertices.size() <= 65536) {
+					view.indexSize = 2;
+					data.shortIndexStorage[i].assign(indices.begin(), indices.end());
+					vector<unsigned int>().swap(indices);
+				}
+				cout << "Optimised mesh " << i << " of " << path << ": " << report.verticesBefore << " -> " << report.verticesAfter
+					<< " vertices, ACMR " << report.acmrBefore << " -> " << report.acmrAfter << ", " << view.indexSize * 8 << " bit indices" << endl;
+			}
+		}
+		static void processMesh(aiMesh* mesh, ModelData& data)
 		{
-			vector<Vertex> vertices;
-			vector<unsigned int> indices;
-			vector<Texture> textures;
+			data.vertexStorage.push_back(vector<Vertex>());
+			data.indexStorage.push_back(vector<unsigned int>());
+			vector<Vertex>& vertices = data.vertexStorage.back();
+			vector<unsigned int>& indices = data.indexStorage.back();
+			vertices.reserve(mesh->mNumVertices);
+			indices.reserve((size_t)mesh->mNumFaces * 3);
 			for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 			{
 				Vertex vertex;
-				glm::vec3 vector;
-				vector.x = mesh->mVertices[i].x;
-				vector.y = mesh->mVertices[i].y;
-				vector.z = mesh->mVertices[i].z;
-				vertex.Position = vector;
-
-				vector.x = mesh->mNormals[i].x;
-				vector.y = mesh->mNormals[i].y;
-				vector.z = mesh->mNormals[i].z;
-				vertex.Normal = vector;
+				vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+				vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
 
 				// does the mesh contain texture coordinates?
 				if (mesh->mTextureCoords[0]) {
-					glm::vec2 vec;
-					vec.x = mesh->mTextureCoords[0][i].x;
-					vec.y = mesh->mTextureCoords[0][i].y;
-					vertex.TexCoords = vec;
+					vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
 				} else {
 					vertex.TexCoords = glm::vec2(0.0f, 0.0f);
 				}
@@ -93,44 +307,56 @@ class Model {
 			}
 			// process indices
 			for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-				aiFace face = mesh->mFaces[i];
+				const aiFace& face = mesh->mFaces[i];
 				for (unsigned int j = 0; j < face.mNumIndices; j++) {
 					indices.push_back(face.mIndices[j]);
 				}
 			}
-			// process material
-			if (mesh->mMaterialIndex >= 0) {
-				aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-				vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-				textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-				vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-				textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-			}
-			return Mesh(vertices, indices, textures);
+			MeshView view;
+			view.vertices = NULL;
+			view.vertexCount = (uint32_t)vertices.size();
+			view.indices = NULL;
+			view.indexCount = (uint32_t)indices.size();
+			view.indexSize = 4;
+			view.materialIndex = mesh->mMaterialIndex;
+			data.meshes.push_back(view);
 		}
-		vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName) {
-			vector<Texture> textures;
+		static void collectMaterialTextures(aiMaterial* mat, aiTextureType type, const string& typeName, MaterialData& material) {
 			for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
 				aiString str;
 				mat->GetTexture(type, i, &str);
-				bool skip = false;
-				for (unsigned int j = 0; j < textures_loaded.size(); j++) {
-					if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0) {
-						textures.push_back(textures_loaded[j]);
-						skip = true;
-						break;
-					}
-				}
-				if (!skip) { // if texture hasnt been loaded already, load it
-					Texture texture;
-					texture.id = TextureFromFile(str.C_Str(), directory);
-					texture.type = typeName;
-					texture.path = str.C_Str();
-					textures.push_back(texture);
-					textures_loaded.push_back(texture); // add to loaded textures
+				TextureRef ref;
+				ref.type = typeName;
+				ref.path = str.C_Str();
+				material.textures.push_back(ref);
+			}
+		}
+		//textures are shared process wide, only the first model to ask for an image decodes and uploads it
+		Texture loadTexture(const ModelData& data, const TextureRef& ref, TextureStreamer* streamer) {
+			Texture texture;
+			texture.type = ref.type;
+			texture.path = ref.path;
+			string path = canonicalPath(directory + '/' + ref.path);
+			TextureInfo info;
+			map<string, TextureInfo>::const_iterator found = data.textureInfo.find(ref.path);
+			if (found != data.textureInfo.end()) {
+				info = found->second;
+			}
+			if (!textureRegistry().acquire(path, info, texture.id)) {
+				map<string, Image>::const_iterator image = data.images.find(ref.path);
+				if (image != data.images.end()) {
+					texture.id = uploadTexture2D(image->second, ref.path);
+				} else if (streamer) {
+					//grey until the real diffuse shows up, no highlights until the real specular does
+					glm::vec4 placeholder = ref.type == "texture_specular" ? glm::vec4(0.f, 0.f, 0.f, 1.f) : glm::vec4(0.5f, 0.5f, 0.5f, 1.f);
+					texture.id = streamer->request2D(directory + '/' + ref.path, placeholder);
+				} else {
+					texture.id = TextureFromFile(ref.path.c_str(), directory);
 				}
+				textureRegistry().add(path, info, texture.id);
 			}
-			return textures;
+			textures_loaded.push_back(texture);
+			return texture;
 		}
 		unsigned int TextureFromFile(const char* path, const string& directory) {
 			string filename = string(path);
@@ -150,7 +376,7 @@ class Model {
 				else if (nrComponents == 4)
 					format = GL_RGBA;
 
-				glBindTexture(GL_TEXTURE_2D, textureID);
+				glState().bindTexture(0, GL_TEXTURE_2D, textureID);
 				glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 				glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -0,0 +1,221 @@
+#ifndef NBODY_H
+#define NBODY_H
+
+#include "glm/glm.hpp"
+
+#include "barnes_hut.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <cmath>
+#include <vector>
+using namespace std;
+
+//bodies are padded to a multiple of this with massless ones, so the SIMD loop never needs a tail
+const unsigned int NBODY_LANES = 8;
+
+//gravity over SoA arrays with a kick-drift-kick leapfrog, stepped by SimClock at a fixed rate no matter what the frame rate does
+//forces are a direct sum by default or a Barnes-Hut octree for big swarms, units are whatever the scene uses with G folded into the masses
+class NBodySystem {
+public:
+	float timeStep = 1.f / 240.f;
+	float softening = 0.02f; //keeps close passes from flinging things to infinity
+	bool useSIMD = true;
+	bool barnesHut = false; //O(n log n) tree instead of the O(n^2) sum
+	float openingAngle = 0.5f; //a cell smaller than this times its distance counts as one body, 0 is exact
+
+	unsigned int addBody(glm::vec3 position, glm::vec3 velocity, float mass) {
+		unsigned int i = n++;
+		grow();
+		px[i] = position.x;
+		py[i] = position.y;
+		pz[i] = position.z;
+		vx[i] = velocity.x;
+		vy[i] = velocity.y;
+		vz[i] = velocity.z;
+		m[i] = mass;
+		frozen[i] = 0;
+		accelerationsValid = false;
+		return i;
+	}
+	//drops every body from first on, handy for resizing a swarm at the end of the list
+	void truncate(unsigned int first) {
+		if (first >= n) {
+			return;
+		}
+		n = first;
+		grow();
+		accelerationsValid = false;
+	}
+	void clear() {
+		truncate(0);
+	}
+	unsigned int count() const {
+		return n;
+	}
+	glm::vec3 position(unsigned int i) const {
+		return glm::vec3(px[i], py[i], pz[i]);
+	}
+	glm::vec3 velocity(unsigned int i) const {
+		return glm::vec3(vx[i], vy[i], vz[i]);
+	}
+	void setVelocity(unsigned int i, glm::vec3 velocity) {
+		vx[i] = velocity.x;
+		vy[i] = velocity.y;
+		vz[i] = velocity.z;
+	}
+	float mass(unsigned int i) const {
+		return m[i];
+	}
+	glm::vec3 acceleration(unsigned int i) const {
+		return glm::vec3(ax[i], ay[i], az[i]);
+	}
+	const BarnesHutTree& tree() const {
+		return octree;
+	}
+	//a frozen body keeps its position and velocity but still pulls on everything else
+	void setFrozen(unsigned int i, bool value) {
+		frozen[i] = value;
+	}
+
+	//one leapfrog step, half kick, drift, new forces, half kick
+	void step(ThreadPool* pool) {
+		if (!accelerationsValid) {
+			computeAccelerations(pool);
+		}
+		float half = timeStep * 0.5f;
+		for (unsigned int i = 0; i < n; i++) {
+			if (frozen[i]) {
+				continue;
+			}
+			vx[i] += ax[i] * half;
+			vy[i] += ay[i] * half;
+			vz[i] += az[i] * half;
+			px[i] += vx[i] * timeStep;
+			py[i] += vy[i] * timeStep;
+			pz[i] += vz[i] * timeStep;
+		}
+		computeAccelerations(pool);
+		for (unsigned int i = 0; i < n; i++) {
+			if (frozen[i]) {
+				continue;
+			}
+			vx[i] += ax[i] * half;
+			vy[i] += ay[i] * half;
+			vz[i] += az[i] * half;
+		}
+	}
+	//a = sum over j of m_j * d / (|d|^2 + softening^2)^1.5, split over the pool by body, or by leaf for the tree
+	//limit only refreshes the first limit bodies of the direct sum, for timing a sample of a swarm too big to sum in full
+	void computeAccelerations(ThreadPool* pool, unsigned int limit = 0xFFFFFFFFu) {
+		unsigned int count = limit < n ? limit : n;
+		bool avx2 = useSIMD && cpuHasAVX2();
+		if (barnesHut) {
+			//the tree always does every body, a sample wouldn't save the build
+			octree.build(px.data(), py.data(), pz.data(), m.data(), n);
+			float theta2 = openingAngle * openingAngle;
+			float eps2 = softening * softening;
+			auto leaves = [this, theta2, eps2, avx2](unsigned int begin, unsigned int end) {
+				octree.accelerations(begin, end, theta2, eps2, avx2, ax.data(), ay.data(), az.data());
+			};
+			unsigned int leafCount = (unsigned int)octree.leaves.size();
+			if (pool && n > 256) {
+				pool->parallelFor(leafCount, 16, leaves);
+			} else {
+				leaves(0, leafCount);
+			}
+			accelerationsValid = true;
+			return;
+		}
+		auto range = [this, avx2](unsigned int begin, unsigned int end) {
+#ifdef SIMD_X86
+			if (avx2) {
+				accelerationsAVX2(begin, end);
+				return;
+			}
+#endif
+			accelerationsScalar(begin, end);
+		};
+		if (pool && count > 256) {
+			pool->parallelFor(count, 64, range);
+		} else {
+			range(0, count);
+		}
+		accelerationsValid = count == n;
+	}
+private:
+	unsigned int n = 0;
+	vector<float> px, py, pz;
+	vector<float> vx, vy, vz;
+	vector<float> ax, ay, az;
+	vector<float> m;
+	vector<unsigned char> frozen;
+	bool accelerationsValid = false;
+	BarnesHutTree octree;
+
+	//keeps every array at n rounded up to the lane count, the padding stays massless at the origin
+	void grow() {
+		size_t padded = (n + NBODY_LANES - 1) / NBODY_LANES * NBODY_LANES;
+		vector<float>* arrays[] = { &px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &m };
+		for (vector<float>* array : arrays) {
+			array->resize(padded, 0.f);
+			for (size_t i = n; i < padded; i++) {
+				(*array)[i] = 0.f;
+			}
+		}
+		frozen.resize(padded, 0);
+	}
+
+	void accelerationsScalar(unsigned int begin, unsigned int end) {
+		float eps2 = softening * softening;
+		for (unsigned int i = begin; i < end; i++) {
+			float sx = 0.f, sy = 0.f, sz = 0.f;
+			for (unsigned int j = 0; j < n; j++) {
+				float dx = px[j] - px[i], dy = py[j] - py[i], dz = pz[j] - pz[i];
+				float d2 = dx * dx + dy * dy + dz * dz + eps2;
+				float inv = 1.f / sqrtf(d2);
+				float s = m[j] * inv * inv * inv;
+				sx += dx * s;
+				sy += dy * s;
+				sz += dz * s;
+			}
+			ax[i] = sx;
+			ay[i] = sy;
+			az[i] = sz;
+		}
+	}
+#ifdef SIMD_X86
+	//8 sources at a time against one body, the body itself adds nothing since its d is zero
+	SIMD_AVX2_TARGET void accelerationsAVX2(unsigned int begin, unsigned int end) {
+		const unsigned int padded = (unsigned int)px.size();
+		const __m256 eps2 = _mm256_set1_ps(softening * softening);
+		const __m256 one = _mm256_set1_ps(1.f);
+		for (unsigned int i = begin; i < end; i++) {
+			__m256 xi = _mm256_set1_ps(px[i]), yi = _mm256_set1_ps(py[i]), zi = _mm256_set1_ps(pz[i]);
+			__m256 sx = _mm256_setzero_ps(), sy = _mm256_setzero_ps(), sz = _mm256_setzero_ps();
+			for (unsigned int j = 0; j < padded; j += NBODY_LANES) {
+				__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&px[j]), xi);
+				__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&py[j]), yi);
+				__m256 dz = _mm256_sub_ps(_mm256_loadu_ps(&pz[j]), zi);
+				__m256 d2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, eps2)));
+				__m256 inv = _mm256_div_ps(one, _mm256_sqrt_ps(d2));
+				__m256 s = _mm256_mul_ps(_mm256_loadu_ps(&m[j]), _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+				sx = _mm256_fmadd_ps(dx, s, sx);
+				sy = _mm256_fmadd_ps(dy, s, sy);
+				sz = _mm256_fmadd_ps(dz, s, sz);
+			}
+			ax[i] = horizontalSum(sx);
+			ay[i] = horizontalSum(sy);
+			az[i] = horizontalSum(sz);
+		}
+	}
+	SIMD_AVX2_TARGET static float horizontalSum(__m256 v) {
+		__m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		return _mm_cvtss_f32(sum);
+	}
+#endif
+};
+
+#endif
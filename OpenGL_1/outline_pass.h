@@ -0,0 +1,207 @@
+#ifndef OUTLINE_PASS_H
+#define OUTLINE_PASS_H
+
+#include <glad/glad.h>
+
+#include "glm/glm.hpp"
+
+#include "shader.h"
+#include "gl_state.h"
+
+#include <cmath>
+#include <iostream>
+using namespace std;
+
+//object ids fit in the R8UI attachment, 0 is the background and never gets an outline
+const unsigned int OUTLINE_STYLES = 16;
+
+struct OutlineStyle {
+	glm::vec3 color = glm::vec3(1.f);
+	float width = 0.f; //in pixels, 0 for no outline
+};
+
+//the main pass draws into this instead of the screen, writing every pixel's object id next to its colour
+//outlines are then found on the screen rather than by drawing everything again bigger:
+//  seed    every pixel of an object that has an outline stores its own coordinates
+//  flood   jump flooding, each pixel looks at its 8 neighbours step pixels away and keeps the nearest
+//          seed any of them knows of, step halves every pass down to 1
+//  resolve copies the scene to the screen, background pixels within an object's width of its nearest
+//          seed take that object's colour
+//that's log2(widest outline) + 2 full screen passes however many triangles the objects have
+class OutlinePass {
+public:
+	OutlineStyle styles[OUTLINE_STYLES];
+	bool enabled = true;
+	//stats for the ui
+	unsigned int floodPasses = 0; //last resolve()
+
+	OutlinePass() :
+		seedShader(".\\shaders\\fullscreen.vs", ".\\shaders\\outline_seed.fs"),
+		floodShader(".\\shaders\\fullscreen.vs", ".\\shaders\\outline_flood.fs"),
+		resolveShader(".\\shaders\\fullscreen.vs", ".\\shaders\\outline_resolve.fs") {
+		//the full screen triangle comes from gl_VertexID, but core profile still wants a VAO bound to draw
+		glGenVertexArrays(1, &emptyVAO);
+		seedShader.use();
+		seedShader.setInt("objectIds", 0);
+		floodShader.use();
+		floodShader.setInt("seeds", 0);
+		resolveShader.use();
+		resolveShader.setInt("scene", 0);
+		resolveShader.setInt("objectIds", 1);
+		resolveShader.setInt("seeds", 2);
+		seedStyles = seedShader.handle("styles");
+		resolveStyles = resolveShader.handle("styles");
+		stepLoc = floodShader.handle("step");
+		outlinesLoc = resolveShader.handle("outlines");
+	}
+	OutlinePass(const OutlinePass&) = delete;
+	OutlinePass& operator=(const OutlinePass&) = delete;
+
+	//binds the scene targets for the main pass, remade first if the framebuffer changed size
+	void begin(int width, int height) {
+		if (width != this->width || height != this->height) {
+			create(width, height);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+		glViewport(0, 0, width, height);
+		const GLfloat clearColor[] = { 0.f, 0.f, 0.f, 1.f };
+		const GLuint clearId[] = { 0, 0, 0, 0 };
+		glClearBufferfv(GL_COLOR, 0, clearColor);
+		glClearBufferuiv(GL_COLOR, 1, clearId);
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+	//puts the finished frame, outlines and all, on the default framebuffer and leaves that bound
+	void resolve() {
+		if (sceneFBO == 0) {
+			return; //minimised, begin() left the default framebuffer bound
+		}
+		glm::vec4 packed[OUTLINE_STYLES];
+		float widest = 0.f;
+		for (unsigned int i = 0; i < OUTLINE_STYLES; i++) {
+			packed[i] = glm::vec4(styles[i].color, styles[i].width);
+			if (i > 0 && styles[i].width > widest) {
+				widest = styles[i].width;
+			}
+		}
+		glDisable(GL_DEPTH_TEST);
+		glState().bindVertexArray(emptyVAO);
+		floodPasses = 0;
+		unsigned int current = 0;
+		bool outlines = enabled && widest > 0.f;
+		if (outlines) {
+			glBindFramebuffer(GL_FRAMEBUFFER, floodFBO[current]);
+			seedShader.use();
+			seedShader.setVec4(seedStyles, packed, OUTLINE_STYLES);
+			glState().bindTexture(0, GL_TEXTURE_2D, idTexture);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+			//the first step has to reach the widest outline, the halvings after it fill in everything closer
+			int step = 1;
+			while (step < (int)ceilf(widest)) {
+				step *= 2;
+			}
+			floodShader.use();
+			for (; step >= 1; step /= 2) {
+				glBindFramebuffer(GL_FRAMEBUFFER, floodFBO[1 - current]);
+				glState().bindTexture(0, GL_TEXTURE_2D, floodTexture[current]);
+				floodShader.setInt(stepLoc, step);
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+				current = 1 - current;
+				floodPasses++;
+			}
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		resolveShader.use();
+		resolveShader.setBool(outlinesLoc, outlines);
+		resolveShader.setVec4(resolveStyles, packed, OUTLINE_STYLES);
+		glState().bindTexture(0, GL_TEXTURE_2D, colorTexture);
+		glState().bindTexture(1, GL_TEXTURE_2D, idTexture);
+		glState().bindTexture(2, GL_TEXTURE_2D, floodTexture[current]);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glEnable(GL_DEPTH_TEST);
+	}
+	void destroy() {
+		release();
+		glDeleteVertexArrays(1, &emptyVAO);
+		glDeleteProgram(seedShader.ID);
+		glDeleteProgram(floodShader.ID);
+		glDeleteProgram(resolveShader.ID);
+	}
+private:
+	Shader seedShader;
+	Shader floodShader;
+	Shader resolveShader;
+	UniformHandle seedStyles;
+	UniformHandle resolveStyles;
+	UniformHandle stepLoc;
+	UniformHandle outlinesLoc;
+	GLuint emptyVAO = 0;
+	int width = 0, height = 0;
+	GLuint sceneFBO = 0;
+	GLuint colorTexture = 0;
+	GLuint idTexture = 0;
+	GLuint depthBuffer = 0;
+	//nearest seed so far as coordinates + 1, 0 for none yet, ping-ponged between flood passes
+	GLuint floodFBO[2] = { 0, 0 };
+	GLuint floodTexture[2] = { 0, 0 };
+
+	//integer textures can't be filtered, and nothing here samples in between pixels anyway
+	static GLuint screenTexture(GLint internalFormat, GLenum format, GLenum type, int width, int height) {
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glState().bindTexture(0, GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return texture;
+	}
+	void create(int width, int height) {
+		release();
+		this->width = width;
+		this->height = height;
+		if (width == 0 || height == 0) {
+			return; //minimised
+		}
+		colorTexture = screenTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+		idTexture = screenTexture(GL_R8UI, GL_RED_INTEGER, GL_UNSIGNED_BYTE, width, height);
+		glGenRenderbuffers(1, &depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glGenFramebuffers(1, &sceneFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, idTexture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		const GLenum attachments[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, attachments);
+		check("SCENE");
+		for (int i = 0; i < 2; i++) {
+			floodTexture[i] = screenTexture(GL_RG16UI, GL_RG_INTEGER, GL_UNSIGNED_SHORT, width, height);
+			glGenFramebuffers(1, &floodFBO[i]);
+			glBindFramebuffer(GL_FRAMEBUFFER, floodFBO[i]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, floodTexture[i], 0);
+			check("FLOOD");
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+	void check(const char* name) {
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			cout << "ERROR::FRAMEBUFFER::" << name << "::INCOMPLETE" << endl;
+		}
+	}
+	void release() {
+		glDeleteFramebuffers(1, &sceneFBO);
+		glDeleteFramebuffers(2, floodFBO);
+		glDeleteRenderbuffers(1, &depthBuffer);
+		//the tracker could still think one of these is bound and skip binding whatever reuses the name
+		glState().invalidate();
+		glDeleteTextures(1, &colorTexture);
+		glDeleteTextures(1, &idTexture);
+		glDeleteTextures(2, floodTexture);
+		sceneFBO = colorTexture = idTexture = depthBuffer = 0;
+		floodFBO[0] = floodFBO[1] = floodTexture[0] = floodTexture[1] = 0;
+	}
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+//which pass a draw belongs to, the top two bits of its key so every opaque draw sorts before every transparent one
+const unsigned int RENDER_PASS_OPAQUE = 0;
+const unsigned int RENDER_PASS_TRANSPARENT = 1;
+
+//how a draw's key is packed, most significant first
+//  opaque       pass 2 | program 8 | material 16 | outline 4 | depth 24 | 10 spare
+//  transparent  pass 2 | far to near depth 24 | program 8 | material 16 | outline 4 | 10 spare
+//opaque draws group by state so programs and textures change as little as possible, and go front to back
+//inside each group so early-z throws away what's behind, transparent ones have to go back to front
+//whatever state that costs
+namespace RenderKey {
+	//top 24 bits of a non-negative float, its ordering as an integer matches its ordering as a float
+	inline uint64_t depthBits(float distance) {
+		if (!(distance > 0.f)) {
+			return 0;
+		}
+		uint32_t bits;
+		memcpy(&bits, &distance, sizeof(bits));
+		return bits >> 8;
+	}
+	inline uint64_t opaque(unsigned int program, unsigned int material, unsigned int outline, float distance) {
+		return (uint64_t)RENDER_PASS_OPAQUE << 62 | (uint64_t)(program & 0xFF) << 54 | (uint64_t)(material & 0xFFFF) << 38
+			| (uint64_t)(outline & 0xF) << 34 | depthBits(distance) << 10;
+	}
+	inline uint64_t transparent(unsigned int program, unsigned int material, unsigned int outline, float distance) {
+		return (uint64_t)RENDER_PASS_TRANSPARENT << 62 | (0xFFFFFF - depthBits(distance)) << 38 | (uint64_t)(program & 0xFF) << 30
+			| (uint64_t)(material & 0xFFFF) << 14 | (uint64_t)(outline & 0xF) << 10;
+	}
+	inline unsigned int pass(uint64_t key) {
+		return (unsigned int)(key >> 62);
+	}
+}
+
+struct SortItem {
+	uint64_t key;
+	unsigned int index; //of the draw the key belongs to
+};
+
+//least significant byte first, 8 counting passes at most, stable so equal keys keep the order they came in
+//a byte every key shares is skipped, with the spare bits and few programs that's usually most of them
+inline void radixSort(vector<SortItem>& items, vector<SortItem>& scratch) {
+	scratch.resize(items.size());
+	uint64_t differing = 0;
+	for (unsigned int i = 1; i < items.size(); i++) {
+		differing |= items[i].key ^ items[0].key;
+	}
+	for (unsigned int shift = 0; shift < 64; shift += 8) {
+		if (((differing >> shift) & 0xFF) == 0) {
+			continue;
+		}
+		unsigned int offsets[256] = { 0 };
+		for (unsigned int i = 0; i < items.size(); i++) {
+			offsets[(items[i].key >> shift) & 0xFF]++;
+		}
+		unsigned int total = 0;
+		for (unsigned int b = 0; b < 256; b++) {
+			unsigned int count = offsets[b];
+			offsets[b] = total;
+			total += count;
+		}
+		for (unsigned int i = 0; i < items.size(); i++) {
+			scratch[offsets[(items[i].key >> shift) & 0xFF]++] = items[i];
+		}
+		items.swap(scratch);
+	}
+}
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <cmath>
+#include <vector>
+using namespace std;
+
+//one transform in the hierarchy, the local matrix is built right to left as
+//scale -> spin -> tilt -> offset -> orbit -> inclination, which covers every chain the old move* functions did
+//angles are in degrees, rates in degrees per second, the moving ones are doubles kept in [0, 360)
+//so they neither lose precision nor drift however long the clock runs
+struct SceneNode {
+	int parent = -1; //always a lower index than the node itself
+
+	glm::vec3 inclinationAxis = glm::vec3(0.f, 0.f, 1.f);
+	float inclination = 0.f;
+	glm::vec3 orbitAxis = glm::vec3(0.f, 1.f, 0.f);
+	double orbitAngle = 0.0;
+	double previousOrbitAngle = 0.0; //as of the step before, for interpolating
+	float orbitRate = 0.f;
+	glm::vec3 offset = glm::vec3(0.f);
+	glm::vec3 tiltAxis = glm::vec3(1.f, 0.f, 0.f);
+	float tilt = 0.f;
+	glm::vec3 spinAxis = glm::vec3(0.f, 1.f, 0.f);
+	double spinAngle = 0.0;
+	double previousSpinAngle = 0.0;
+	float spinRate = 0.f;
+	float scale = 1.f;
+
+	bool paused = false; //stops orbit and spin from advancing, the node keeps its last transform
+	bool dirty = true;
+
+	glm::mat4 local = glm::mat4(1.f);
+	glm::mat4 world = glm::mat4(1.f);
+
+	//world space position, handy for lights
+	glm::vec3 position() const {
+		return glm::vec3(world[3]);
+	}
+	//call after changing any of the transform fields by hand
+	void markDirty() {
+		dirty = true;
+	}
+};
+
+//flat array of nodes kept in parent-before-child order, so one linear pass updates the whole tree
+class SceneGraph {
+public:
+	vector<SceneNode> nodes;
+	//how many world matrices the last update() actually rebuilt
+	unsigned int recomputed = 0;
+
+	int addNode(int parent = -1) {
+		nodes.push_back(SceneNode());
+		nodes.back().parent = parent;
+		changed.push_back(true);
+		return (int)nodes.size() - 1;
+	}
+	SceneNode& operator[](int i) {
+		return nodes[i];
+	}
+	const SceneNode& operator[](int i) const {
+		return nodes[i];
+	}
+
+	//steps fixed simulation steps, paused nodes hold still
+	//update() blends from where this started to where it ends up, one step at a time so it comes out
+	//the same however the steps are batched
+	void advance(double step, unsigned int steps = 1) {
+		for (unsigned int i = 0; i < nodes.size(); i++) {
+			SceneNode& node = nodes[i];
+			node.previousOrbitAngle = node.orbitAngle;
+			node.previousSpinAngle = node.spinAngle;
+			if (node.paused) {
+				continue;
+			}
+			for (unsigned int k = 0; k < steps; k++) {
+				node.orbitAngle = wrapDegrees(node.orbitAngle + node.orbitRate * step);
+				node.spinAngle = wrapDegrees(node.spinAngle + node.spinRate * step);
+			}
+		}
+	}
+	//single top-down pass, a node is only rebuilt if it or something above it changed
+	//animated nodes are drawn alpha of the way between their last two steps, so they count as changed every frame
+	void update(float alpha = 1.f) {
+		recomputed = 0;
+		for (unsigned int i = 0; i < nodes.size(); i++) {
+			SceneNode& node = nodes[i];
+			if (!node.paused && (node.orbitRate != 0.f || node.spinRate != 0.f)) {
+				node.dirty = true;
+			}
+			bool parentChanged = node.parent >= 0 && changed[node.parent];
+			changed[i] = node.dirty || parentChanged;
+			if (!changed[i]) {
+				continue;
+			}
+			if (node.dirty) {
+				node.local = buildLocal(node, alpha);
+				node.dirty = false;
+			}
+			node.world = node.parent >= 0 ? nodes[node.parent].world * node.local : node.local;
+			recomputed++;
+		}
+	}
+private:
+	vector<bool> changed; //per node, set during update() for the children to look at
+
+	static double wrapDegrees(double angle) {
+		angle = fmod(angle, 360.0);
+		return angle < 0.0 ? angle + 360.0 : angle;
+	}
+	//the short way round from previous to current, they're both wrapped
+	static float blendDegrees(double previous, double current, float alpha) {
+		double delta = current - previous;
+		if (delta > 180.0) {
+			delta -= 360.0;
+		} else if (delta < -180.0) {
+			delta += 360.0;
+		}
+		return (float)(previous + delta * alpha);
+	}
+	static glm::mat4 buildLocal(const SceneNode& node, float alpha) {
+		float orbitAngle = blendDegrees(node.previousOrbitAngle, node.orbitAngle, alpha);
+		float spinAngle = blendDegrees(node.previousSpinAngle, node.spinAngle, alpha);
+		glm::mat4 m = glm::mat4(1.f);
+		if (node.inclination != 0.f) {
+			m = glm::rotate(m, glm::radians(node.inclination), node.inclinationAxis);
+		}
+		if (orbitAngle != 0.f) {
+			m = glm::rotate(m, glm::radians(orbitAngle), node.orbitAxis);
+		}
+		m = glm::translate(m, node.offset);
+		if (node.tilt != 0.f) {
+			m = glm::rotate(m, glm::radians(node.tilt), node.tiltAxis);
+		}
+		if (spinAngle != 0.f) {
+			m = glm::rotate(m, glm::radians(spinAngle), node.spinAxis);
+		}
+		if (node.scale != 1.f) {
+			m = glm::scale(m, glm::vec3(node.scale));
+		}
+		return m;
+	}
+};
+
+#endif
@@ -5,14 +5,43 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
 
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
+
+#include "gl_state.h"
+
+//resolved uniform location, grab one with Shader::handle() once and reuse it every draw
+//an unknown name gives location -1, which GL silently ignores just like glGetUniformLocation would
+struct UniformHandle {
+	GLint location = -1;
+	bool valid() const { return location != -1; }
+};
+
+//one row of the reflected uniform table
+struct UniformInfo {
+	std::string name;
+	GLint location;
+	GLenum type;
+	GLint size;
+};
+
 class Shader {
 public:
 	//the program ID
 	unsigned int ID;
+	//every active uniform of the linked program, filled once by reflectUniforms()
+	std::vector<UniformInfo> uniforms;
+	//handles for the per-draw uniforms every program here shares
+	UniformHandle modelLoc;
+	UniformHandle normalLoc;
+	UniformHandle objectIdLoc; //which outline style the pixels drawn belong to, see OutlinePass
+	UniformHandle positionOffsetLoc; //how the vertex shaders decode compact vertices, see vertex_format.h
+	UniformHandle positionScaleLoc;
+	UniformHandle octNormalsLoc;
 	//constructor reads and builds the shader
 	Shader(const char* vertexPath, const char* fragmentPath) {
 		//retrieve the vertex/fragment source code from filePath
@@ -35,8 +64,8 @@ public:
 			vShaderFile.close();
 			fShaderFile.close();
 			// convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
+			vertexCode = expandIncludes(vShaderStream.str(), directoryOf(vertexPath));
+			fragmentCode = expandIncludes(fShaderStream.str(), directoryOf(fragmentPath));
 		} catch (std::ifstream::failure e) {
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 		}
@@ -85,32 +114,150 @@ public:
 		// delete shaders; theyre linked into our program and no longer necessary
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
+
+		reflectUniforms();
+		modelLoc = handle("model");
+		normalLoc = handle("transNormal");
+		objectIdLoc = handle("objectId");
+		positionOffsetLoc = handle("positionOffset");
+		positionScaleLoc = handle("positionScale");
+		octNormalsLoc = handle("octNormals");
 	};
-	// use/activate the shader
+	// use/activate the shader, skipped if it's already the current program
 	void use() {
-		glUseProgram(ID);
+		glState().useProgram(ID);
+	}
+	// look up a uniform in the reflected table, no driver round trip
+	UniformHandle handle(const std::string& name) const {
+		auto it = uniformIndex.find(name);
+		if (it == uniformIndex.end()) {
+			return UniformHandle();
+		}
+		return UniformHandle{ it->second };
+	}
+	// hook a named uniform block up to a binding point, does nothing if the program doesn't use the block
+	void bindUniformBlock(const std::string& name, GLuint binding) const {
+		GLuint blockIndex = glGetUniformBlockIndex(ID, name.c_str());
+		if (blockIndex != GL_INVALID_INDEX) {
+			glUniformBlockBinding(ID, blockIndex, binding);
+		}
+	}
+	// handle based uniform functions, these are what the render loop should be calling
+	void setBool(UniformHandle h, bool value) const {
+		glUniform1i(h.location, (int)value);
+	}
+	void setInt(UniformHandle h, int value) const {
+		glUniform1i(h.location, value);
 	}
-	// utility uniform functions
+	void setFloat(UniformHandle h, float value) const {
+		glUniform1f(h.location, value);
+	}
+	void setMat4(UniformHandle h, const glm::mat4& mat) const {
+		glUniformMatrix4fv(h.location, 1, GL_FALSE, glm::value_ptr(mat));
+	}
+	void setMat3(UniformHandle h, const glm::mat3& mat) const {
+		glUniformMatrix3fv(h.location, 1, GL_FALSE, glm::value_ptr(mat));
+	}
+	void setVec3(UniformHandle h, float val1, float val2, float val3) const {
+		glUniform3f(h.location, val1, val2, val3);
+	}
+	void setVec3(UniformHandle h, const glm::vec3& value) const {
+		glUniform3fv(h.location, 1, glm::value_ptr(value));
+	}
+	void setVec4(UniformHandle h, const glm::vec4* values, int count) const {
+		glUniform4fv(h.location, count, glm::value_ptr(values[0]));
+	}
+	// what the mesh about to be drawn needs to decode its vertices, every draw sets it since programs keep the last one
+	void setVertexDecode(const glm::vec3& offset, const glm::vec3& scale, bool octNormals) const {
+		setVec3(positionOffsetLoc, offset);
+		setVec3(positionScaleLoc, scale);
+		setBool(octNormalsLoc, octNormals);
+	}
+	// utility uniform functions by name, fine for one-off setup, they still go through the table
 	void setBool(const std::string& name, bool value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		setBool(handle(name), value);
 	}
 	void setInt(const std::string& name, int value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		setInt(handle(name), value);
 	}
 	void setFloat(const std::string& name, float value) const {
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		setFloat(handle(name), value);
 	}
-	void setMat4(const std::string& name, glm::mat4 mat) const {
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+	void setMat4(const std::string& name, const glm::mat4& mat) const {
+		setMat4(handle(name), mat);
 	}
-	void setMat3(const std::string& name, glm::mat3 mat) const {
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+	void setMat3(const std::string& name, const glm::mat3& mat) const {
+		setMat3(handle(name), mat);
 	}
 	void setVec3(const std::string& name, float val1, float val2, float val3) const {
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(glm::vec3(val1, val2, val3)));
+		setVec3(handle(name), val1, val2, val3);
 	}
-	void setVec3(const std::string& name, glm::vec3 value) const {
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+	void setVec3(const std::string& name, const glm::vec3& value) const {
+		setVec3(handle(name), value);
+	}
+private:
+	static std::string directoryOf(const std::string& path) {
+		size_t slash = path.find_last_of("\\/");
+		return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	}
+	// GLSL has no includes of its own, a line that's just #include "file" gets swapped for that file, found next to the shader
+	static std::string expandIncludes(const std::string& source, const std::string& directory) {
+		std::stringstream in(source);
+		std::string out, line;
+		while (std::getline(in, line)) {
+			size_t start = line.find('"');
+			size_t end = start == std::string::npos ? start : line.find('"', start + 1);
+			if (line.compare(0, 9, "#include ") != 0 || end == std::string::npos) {
+				out += line + '\n';
+				continue;
+			}
+			std::string name = line.substr(start + 1, end - start - 1);
+			std::ifstream file(directory + name);
+			if (!file) {
+				std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND " << directory + name << std::endl;
+				continue;
+			}
+			std::stringstream contents;
+			contents << file.rdbuf();
+			out += contents.str() + '\n';
+		}
+		return out;
+	}
+	//name -> location, every array element gets its own entry ("arr[2]"), plus the bare "arr"
+	std::unordered_map<std::string, GLint> uniformIndex;
+
+	//ask the driver for every active uniform once, right after linking
+	void reflectUniforms() {
+		GLint count = 0;
+		GLint maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+		uniforms.reserve(count);
+		for (GLint i = 0; i < count; i++) {
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+			std::string name(nameBuffer.data(), length);
+			GLint location = glGetUniformLocation(ID, name.c_str());
+			//uniforms living in a uniform block have no location, they're not settable this way anyway
+			if (location == -1) {
+				continue;
+			}
+			uniforms.push_back({ name, location, type, size });
+			uniformIndex[name] = location;
+			//arrays of plain types come back as a single "name[0]" entry, expand the rest of the elements
+			std::size_t bracket = name.rfind("[0]");
+			if (bracket != std::string::npos && bracket + 3 == name.size()) {
+				std::string base = name.substr(0, bracket);
+				uniformIndex[base] = location;
+				for (GLint e = 1; e < size; e++) {
+					std::string element = base + "[" + std::to_string(e) + "]";
+					uniformIndex[element] = glGetUniformLocation(ID, element.c_str());
+				}
+			}
+		}
 	}
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,7 @@
+#version 330 core
+//one triangle big enough to cover the screen, the corners come from gl_VertexID so there is no vertex buffer
+void main()
+{
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
\ No newline at end of file
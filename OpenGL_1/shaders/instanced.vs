@@ -0,0 +1,39 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+//per instance, see InstanceData in instance_buffer.h
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in mat3 aTransNormal;
+
+out vec3 normal;
+out vec2 texCoords;
+out vec3 fragPos;
+
+struct PointLight {
+	vec3 position;
+	float constant;
+	vec3 ambient;
+	float linear;
+	vec3 diffuse;
+	float quadratic;
+	vec3 specular;
+};
+#define NR_POINT_LIGHTS 2
+layout (std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	PointLight pointLights[NR_POINT_LIGHTS];
+};
+
+#include "vertex_decode.glsl"
+
+void main()
+{
+	vec4 worldPos = aModel * vec4(decodePosition(), 1.0);
+	gl_Position = projection * view * worldPos;
+	texCoords = aTexCoords;
+	normal = aTransNormal * decodeNormal();
+	fragPos = vec3(worldPos);
+}
\ No newline at end of file
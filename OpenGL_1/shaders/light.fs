@@ -1,5 +1,6 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out uint FragObjectId; //for OutlinePass
 
 in vec2 texCoords;
 
@@ -7,8 +8,10 @@ struct Material {
 	sampler2D diffuse;
 };
 uniform Material material;
+uniform int objectId;
 
 void main()
 {
     FragColor = texture(material.diffuse, texCoords);
+    FragObjectId = uint(objectId);
 }   
\ No newline at end of file
@@ -1,21 +0,0 @@
-#version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec2 aTexCoords;
-
-out vec3 normal;
-out vec2 texCoords;
-out vec3 fragPos;
-
-uniform mat4 model;
-uniform mat3 transNormal;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
-	texCoords = aTexCoords;
-	normal = transNormal * aNormal;
-	fragPos = vec3(model * vec4(aPos, 1.0));
-}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+//per instance and never touched after upload, see OrbitInstance in kepler.h
+layout (location = 3) in vec4 aPeriapsis; //unit vector to periapsis, w semi-major axis
+layout (location = 4) in vec4 aAhead; //unit vector 90 degrees on, w semi-minor axis
+layout (location = 5) in vec4 aMotion; //eccentricity, mean motion, mean anomaly at the epoch, size
+layout (location = 6) in vec4 aSpin; //axis times radians per second, w angle at the epoch
+
+out vec3 normal;
+out vec2 texCoords;
+out vec3 fragPos;
+
+struct PointLight {
+	vec3 position;
+	float constant;
+	vec3 ambient;
+	float linear;
+	vec3 diffuse;
+	float quadratic;
+	vec3 specular;
+};
+#define NR_POINT_LIGHTS 2
+layout (std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	PointLight pointLights[NR_POINT_LIGHTS];
+};
+
+#include "vertex_decode.glsl"
+
+//seconds since the buffer's epoch, kept short by OrbitBuffer so a float is plenty
+uniform float time;
+
+const float PI = 3.14159265;
+const float TWO_PI = 6.28318531;
+
+//same fixed Newton steps as KeplerOrbits, so the GPU and CPU belts line up
+vec3 orbitPosition()
+{
+	float e = aMotion.x;
+	float M = mod(aMotion.z + aMotion.y * time + PI, TWO_PI) - PI;
+	float E = M + e * sin(M);
+	for (int i = 0; i < 4; i++) {
+		E -= (E - e * sin(E) - M) / (1.0 - e * cos(E));
+	}
+	return aPeriapsis.xyz * (aPeriapsis.w * (cos(E) - e)) + aAhead.xyz * (aAhead.w * sin(E));
+}
+
+//rotation by angle about a unit axis
+mat3 spinMatrix(vec3 axis, float angle)
+{
+	float s = sin(angle), c = cos(angle);
+	vec3 t = axis * (1.0 - c);
+	return mat3(t.x * axis + vec3(c, axis.z * s, -axis.y * s),
+		t.y * axis + vec3(-axis.z * s, c, axis.x * s),
+		t.z * axis + vec3(axis.y * s, -axis.x * s, c));
+}
+
+void main()
+{
+	float rate = length(aSpin.xyz);
+	mat3 spin = rate > 0.0 ? spinMatrix(aSpin.xyz / rate, mod(aSpin.w + rate * time, TWO_PI)) : mat3(1.0);
+	//rotation and a uniform scale, so the rotation alone does for the normals
+	fragPos = spin * decodePosition() * aMotion.w + orbitPosition();
+	gl_Position = projection * view * vec4(fragPos, 1.0);
+	texCoords = aTexCoords;
+	normal = spin * decodeNormal();
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#version 330 core
+out uvec2 nearest;
+
+uniform usampler2D seeds;
+uniform int step;
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	ivec2 size = textureSize(seeds, 0);
+	uvec2 best = uvec2(0u);
+	float bestDistance = 1e20;
+	for (int y = -1; y <= 1; y++) {
+		for (int x = -1; x <= 1; x++) {
+			ivec2 p = pixel + ivec2(x, y) * step;
+			if (any(lessThan(p, ivec2(0))) || any(greaterThanEqual(p, size))) {
+				continue;
+			}
+			uvec2 seed = texelFetch(seeds, p, 0).rg;
+			if (seed.x == 0u) {
+				continue;
+			}
+			vec2 d = vec2(ivec2(seed) - 1 - pixel);
+			if (dot(d, d) < bestDistance) {
+				bestDistance = dot(d, d);
+				best = seed;
+			}
+		}
+	}
+	nearest = best;
+}
\ No newline at end of file
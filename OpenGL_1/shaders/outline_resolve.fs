@@ -0,0 +1,26 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D scene;
+uniform usampler2D objectIds;
+uniform usampler2D seeds;
+uniform bool outlines;
+uniform vec4 styles[16]; //rgb colour, a width in pixels
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec4 color = texelFetch(scene, pixel, 0);
+	//only the background gets outlined, same as the old stencil version, so nothing is drawn over an object
+	if (outlines && texelFetch(objectIds, pixel, 0).r == 0u) {
+		uvec2 seed = texelFetch(seeds, pixel, 0).rg;
+		if (seed.x != 0u) {
+			ivec2 seedPixel = ivec2(seed) - 1;
+			vec4 style = styles[texelFetch(objectIds, seedPixel, 0).r];
+			//half a pixel of falloff at the edge so it doesn't stair step
+			float coverage = clamp(style.a + 0.5 - length(vec2(seedPixel - pixel)), 0.0, 1.0);
+			color.rgb = mix(color.rgb, style.rgb, coverage);
+		}
+	}
+	FragColor = color;
+}
\ No newline at end of file
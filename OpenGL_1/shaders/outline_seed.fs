@@ -0,0 +1,13 @@
+#version 330 core
+out uvec2 seed;
+
+uniform usampler2D objectIds;
+uniform vec4 styles[16]; //rgb colour, a width in pixels
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	uint id = texelFetch(objectIds, pixel, 0).r;
+	//coordinates + 1 so 0 can mean nothing found yet
+	seed = (id != 0u && styles[id].a > 0.0) ? uvec2(pixel + 1) : uvec2(0u);
+}
\ No newline at end of file
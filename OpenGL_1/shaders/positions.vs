@@ -0,0 +1,38 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+//per instance, see PositionBuffer in instance_buffer.h, xyz is where the body is and w how big
+layout (location = 3) in vec4 aPosition;
+
+out vec3 normal;
+out vec2 texCoords;
+out vec3 fragPos;
+
+struct PointLight {
+	vec3 position;
+	float constant;
+	vec3 ambient;
+	float linear;
+	vec3 diffuse;
+	float quadratic;
+	vec3 specular;
+};
+#define NR_POINT_LIGHTS 2
+layout (std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	PointLight pointLights[NR_POINT_LIGHTS];
+};
+
+#include "vertex_decode.glsl"
+
+void main()
+{
+	//no rotation and a uniform scale, so the normals don't need a matrix at all
+	fragPos = decodePosition() * aPosition.w + aPosition.xyz;
+	gl_Position = projection * view * vec4(fragPos, 1.0);
+	texCoords = aTexCoords;
+	normal = decodeNormal();
+}
\ No newline at end of file
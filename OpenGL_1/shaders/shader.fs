@@ -1,13 +1,13 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out uint FragObjectId; //for OutlinePass
 
 in vec3 ourColor;
 in vec3 normal;
 in vec2 texCoords;
 in vec3 fragPos;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
+uniform int objectId;
 
 struct Material {
 	vec3 ambient;
@@ -17,19 +17,24 @@ struct Material {
 };
 uniform Material material;
 
+//laid out for std140, every float sits in the spare slot after a vec3
 struct PointLight {
 	vec3 position;
-
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-
 	float constant;
+	vec3 ambient;
 	float linear;
+	vec3 diffuse;
 	float quadratic;
+	vec3 specular;
 };
 #define NR_POINT_LIGHTS 2
-uniform PointLight pointLights[NR_POINT_LIGHTS];
+//filled once per frame from FrameUniformBuffer, shared with every other program
+layout (std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	PointLight pointLights[NR_POINT_LIGHTS];
+};
 
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
@@ -71,5 +76,6 @@ void main()
 		discard;
 	}
 	FragColor = texColor;
+	FragObjectId = uint(objectId);
 	//FragColor = texture(material.texture_diffuse1, texCoords);
 }
\ No newline at end of file
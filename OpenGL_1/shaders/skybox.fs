@@ -1,5 +1,6 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out uint FragObjectId; //for OutlinePass
 
 in vec3 TexCoords;
 
@@ -8,4 +9,5 @@ uniform samplerCube skybox;
 void main()
 {    
     FragColor = texture(skybox, TexCoords);
+    FragObjectId = 0u; //background, what outlines get drawn over
 }
\ No newline at end of file
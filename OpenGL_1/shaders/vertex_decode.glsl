@@ -0,0 +1,24 @@
+//pasted into the vertex shaders by Shader wherever they say #include "vertex_decode.glsl"
+//they have to declare aPos and aNormal first, see vertex_format.h for the packing
+//full models come with offset 0, scale 1 and octNormals off, so the same code reads both
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform bool octNormals;
+
+vec3 decodePosition()
+{
+	return positionOffset + aPos * positionScale;
+}
+
+vec3 decodeNormal()
+{
+	if (!octNormals) {
+		return aNormal;
+	}
+	vec2 e = aNormal.xy;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
\ No newline at end of file
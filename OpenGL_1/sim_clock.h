@@ -0,0 +1,50 @@
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+#include <cmath>
+#include <cstdint>
+using namespace std;
+
+//the one source of simulated time, counted in whole fixed steps so it stays exact however long it runs
+//real frame time goes in scaled by timeScale, whole steps come out, and the leftover is how far into the
+//next step we are, the same number of ticks always means the same simulation
+//the render side interpolates off BodySnapshot instead, it never sees the clock
+class SimClock {
+public:
+	double stepSeconds = 1.0 / 240.0;
+	float timeScale = 1.f;
+	unsigned int maxStepsPerFrame = 32; //past this we'd rather run slow than spiral
+	bool paused = false;
+
+	//how many steps to run for realSeconds of wall clock
+	unsigned int advance(double realSeconds) {
+		if (paused) {
+			return 0;
+		}
+		accumulator += realSeconds * timeScale;
+		uint64_t steps = (uint64_t)(accumulator / stepSeconds);
+		accumulator -= steps * stepSeconds;
+		if (steps > maxStepsPerFrame) {
+			steps = maxStepsPerFrame;
+		}
+		ticks += steps;
+		return (unsigned int)steps;
+	}
+	uint64_t tick() const {
+		return ticks;
+	}
+	//how far into the next step we are, 0 to 1
+	float alpha() const {
+		return (float)(accumulator / stepSeconds);
+	}
+	//rate * time wrapped into [0, period), worked out from scratch each call so there's nothing to drift
+	static float phaseAt(double time, double rate, double period = 360.0) {
+		double p = fmod(rate * time, period);
+		return (float)(p < 0.0 ? p + period : p);
+	}
+private:
+	uint64_t ticks = 0;
+	double accumulator = 0.0; //unstepped seconds, always less than a step
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+//the hot loops have an AVX2 version picked at runtime, so the exe still runs on machines without it
+//SIMD_AVX2_TARGET lets gcc/clang compile AVX2 intrinsics in a function without -mavx2 for the whole build,
+//msvc is fine with them anywhere
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIMD_AVX2_TARGET
+#else
+#define SIMD_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+//AVX2 and FMA, plus the OS saving the ymm registers on context switches
+inline bool detectAVX2() {
+#if defined(SIMD_X86) && defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 1);
+	bool fma = (regs[2] & (1 << 12)) != 0;
+	bool osxsave = (regs[2] & (1 << 27)) != 0;
+	if (!fma || !osxsave || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+#elif defined(SIMD_X86)
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+	return false;
+#endif
+}
+//asked once, the answer doesn't change while we run
+inline bool cpuHasAVX2() {
+	static const bool avx2 = detectAVX2();
+	return avx2;
+}
+
+#ifdef SIMD_X86
+//sin and cos of 8 floats at once, good to a couple of ulp for |x| up to a few thousand
+//folds x into [-pi/4, pi/4] around the nearest multiple of pi/2 (in three parts so the fold stays exact),
+//runs the cephes polynomials and picks and flips the results by quadrant
+SIMD_AVX2_TARGET inline void sincos256(__m256 x, __m256& s, __m256& c) {
+	__m256 j = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(0.63661977236f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	__m256i quadrant = _mm256_cvtps_epi32(j);
+	__m256 r = _mm256_fnmadd_ps(j, _mm256_set1_ps(1.5703125f), x);
+	r = _mm256_fnmadd_ps(j, _mm256_set1_ps(4.837512969970703125e-4f), r);
+	r = _mm256_fnmadd_ps(j, _mm256_set1_ps(7.54978995489188216e-8f), r);
+	__m256 r2 = _mm256_mul_ps(r, r);
+
+	__m256 sinPoly = _mm256_fmadd_ps(_mm256_set1_ps(-1.9515295891e-4f), r2, _mm256_set1_ps(8.3321608736e-3f));
+	sinPoly = _mm256_fmadd_ps(sinPoly, r2, _mm256_set1_ps(-1.6666654611e-1f));
+	sinPoly = _mm256_fmadd_ps(_mm256_mul_ps(sinPoly, r2), r, r);
+	__m256 cosPoly = _mm256_fmadd_ps(_mm256_set1_ps(2.443315711809948e-5f), r2, _mm256_set1_ps(-1.388731625493765e-3f));
+	cosPoly = _mm256_fmadd_ps(cosPoly, r2, _mm256_set1_ps(4.166664568298827e-2f));
+	cosPoly = _mm256_fmadd_ps(_mm256_mul_ps(cosPoly, r2), r2, _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), r2, _mm256_set1_ps(1.f)));
+
+	//odd quadrants swap sin and cos, sin flips in quadrants 2 and 3, cos in 1 and 2
+	__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+	__m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(2)), 30));
+	__m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+	s = _mm256_xor_ps(_mm256_blendv_ps(sinPoly, cosPoly, swap), sinSign);
+	c = _mm256_xor_ps(_mm256_blendv_ps(cosPoly, sinPoly, swap), cosSign);
+}
+#endif
+
+#endif
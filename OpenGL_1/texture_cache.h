@@ -0,0 +1,380 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "image.h"
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+//S3TC is in every desktop driver but only core through the extension, so glad may not have the names
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+//bump this whenever the encoder or the file layout below changes, old caches just get rebaked
+const uint32_t TEXTURE_CACHE_MAGIC = 0x48435854; // "TXCH"
+const uint32_t TEXTURE_CACHE_VERSION = 1;
+const uint32_t TEXTURE_CACHE_MAX_LEVELS = 32; //more than a 65536 wide chain needs, anything past it is a broken file
+
+//GL thread only, asks the driver whether it takes both S3TC formats we bake to
+inline bool s3tcSupported() {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+	if (count <= 0) {
+		return false;
+	}
+	vector<GLint> formats(count);
+	glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+	bool bc1 = false, bc3 = false;
+	for (unsigned int i = 0; i < formats.size(); i++) {
+		bc1 = bc1 || formats[i] == GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		bc3 = bc3 || formats[i] == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	}
+	return bc1 && bc3;
+}
+
+inline bool isCompressedFormat(GLenum format) {
+	return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+//bytes per 4x4 block, 0 for plain formats
+inline unsigned int blockBytes(GLenum format) {
+	if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+		return 8;
+	if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+		return 16;
+	return 0;
+}
+
+//what a width x height level takes in format, whole 4x4 blocks for S3TC and tightly packed rows otherwise
+inline uint64_t levelSize(GLenum format, int channels, uint32_t width, uint32_t height) {
+	unsigned int bytesPerBlock = blockBytes(format);
+	if (bytesPerBlock != 0) {
+		return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * bytesPerBlock;
+	}
+	return (uint64_t)width * height * channels;
+}
+
+//one mip level ready for glTexImage2D/glCompressedTexImage2D
+struct TextureLevel {
+	int width;
+	int height;
+	const unsigned char* data;
+	uint32_t size;
+};
+
+//a texture with its whole mip chain, either straight out of the decoder or mapped from its .texcache
+struct BakedTexture {
+	GLenum format = GL_RGBA; //plain GL_RED/GL_RGB/GL_RGBA or one of the S3TC formats
+	int channels = 4; //only means something for plain formats
+	vector<TextureLevel> levels;
+	bool fromCache = false;
+	//backing storage for a fresh bake
+	vector<vector<unsigned char>> storage;
+	//backing storage for a warm start
+	MappedFile cacheFile;
+
+	bool valid() const {
+		return !levels.empty();
+	}
+	size_t gpuBytes() const {
+		size_t bytes = 0;
+		for (unsigned int i = 0; i < levels.size(); i++) {
+			bytes += levels[i].size;
+		}
+		return bytes;
+	}
+};
+
+//cache sits next to the source, models\earth\earth.png -> models\earth\earth.png.texcache
+inline string textureCachePath(const string& path) {
+	return path + ".texcache";
+}
+
+//2x2 box filter, odd edges reuse their last row/column
+inline vector<unsigned char> downsample(const unsigned char* src, int width, int height, int channels) {
+	int outWidth = width > 1 ? width / 2 : 1;
+	int outHeight = height > 1 ? height / 2 : 1;
+	vector<unsigned char> out((size_t)outWidth * outHeight * channels);
+	for (int y = 0; y < outHeight; y++) {
+		int y0 = y * 2 < height ? y * 2 : height - 1;
+		int y1 = y0 + 1 < height ? y0 + 1 : y0;
+		for (int x = 0; x < outWidth; x++) {
+			int x0 = x * 2 < width ? x * 2 : width - 1;
+			int x1 = x0 + 1 < width ? x0 + 1 : x0;
+			for (int c = 0; c < channels; c++) {
+				unsigned int sum = src[((size_t)y0 * width + x0) * channels + c] + src[((size_t)y0 * width + x1) * channels + c] +
+					src[((size_t)y1 * width + x0) * channels + c] + src[((size_t)y1 * width + x1) * channels + c];
+				out[((size_t)y * outWidth + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+	return out;
+}
+
+inline uint16_t packRGB565(int r, int g, int b) {
+	return (uint16_t)(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+inline void unpackRGB565(uint16_t c, int rgb[3]) {
+	int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+//BC1 colour block from 16 RGBA texels: endpoints from the inset bounding box, every texel snapped to the nearest of the 4 palette colours
+inline void encodeBC1Block(const unsigned char block[64], unsigned char out[8]) {
+	int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 3; c++) {
+			int v = block[i * 4 + c];
+			lo[c] = v < lo[c] ? v : lo[c];
+			hi[c] = v > hi[c] ? v : hi[c];
+		}
+	}
+	//pull the endpoints in a bit, the box corners are rarely the best fit
+	for (int c = 0; c < 3; c++) {
+		int inset = (hi[c] - lo[c]) / 16;
+		lo[c] += inset;
+		hi[c] -= inset;
+	}
+	uint16_t c0 = packRGB565(hi[0], hi[1], hi[2]);
+	uint16_t c1 = packRGB565(lo[0], lo[1], lo[2]);
+	uint32_t indices = 0;
+	if (c0 < c1) {
+		uint16_t t = c0;
+		c0 = c1;
+		c1 = t;
+	}
+	if (c0 != c1) {
+		int palette[4][3];
+		unpackRGB565(c0, palette[0]);
+		unpackRGB565(c1, palette[1]);
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestError = 1 << 30;
+			for (int p = 0; p < 4; p++) {
+				int dr = block[i * 4] - palette[p][0], dg = block[i * 4 + 1] - palette[p][1], db = block[i * 4 + 2] - palette[p][2];
+				int error = dr * dr + dg * dg + db * db;
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (uint32_t)best << (i * 2);
+		}
+	}
+	out[0] = (unsigned char)(c0 & 0xFF);
+	out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)(c1 & 0xFF);
+	out[3] = (unsigned char)(c1 >> 8);
+	memcpy(out + 4, &indices, 4);
+}
+//BC3 alpha block, 8 interpolated values between the min and max alpha
+inline void encodeBC3AlphaBlock(const unsigned char block[64], unsigned char out[8]) {
+	int lo = 255, hi = 0;
+	for (int i = 0; i < 16; i++) {
+		int a = block[i * 4 + 3];
+		lo = a < lo ? a : lo;
+		hi = a > hi ? a : hi;
+	}
+	uint64_t indices = 0;
+	if (hi != lo) {
+		int palette[8] = { hi, lo };
+		for (int p = 1; p < 7; p++) {
+			palette[p + 1] = ((7 - p) * hi + p * lo) / 7;
+		}
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestError = 1 << 30;
+			for (int p = 0; p < 8; p++) {
+				int error = block[i * 4 + 3] - palette[p];
+				error *= error;
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (uint64_t)best << (i * 3);
+		}
+	}
+	out[0] = (unsigned char)hi;
+	out[1] = (unsigned char)lo;
+	for (int i = 0; i < 6; i++) {
+		out[2 + i] = (unsigned char)(indices >> (i * 8));
+	}
+}
+//whole level to BC1 or BC3, edge blocks repeat their last texel
+inline vector<unsigned char> compressLevel(const unsigned char* pixels, int width, int height, int channels, GLenum format) {
+	int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+	unsigned int bytesPerBlock = blockBytes(format);
+	vector<unsigned char> out((size_t)blocksWide * blocksHigh * bytesPerBlock);
+	unsigned char block[64];
+	for (int by = 0; by < blocksHigh; by++) {
+		for (int bx = 0; bx < blocksWide; bx++) {
+			for (int i = 0; i < 16; i++) {
+				int x = bx * 4 + i % 4, y = by * 4 + i / 4;
+				x = x < width ? x : width - 1;
+				y = y < height ? y : height - 1;
+				const unsigned char* texel = pixels + ((size_t)y * width + x) * channels;
+				block[i * 4] = texel[0];
+				block[i * 4 + 1] = texel[channels > 1 ? 1 : 0];
+				block[i * 4 + 2] = texel[channels > 2 ? 2 : 0];
+				block[i * 4 + 3] = channels == 4 ? texel[3] : 255;
+			}
+			unsigned char* dst = &out[((size_t)by * blocksWide + bx) * bytesPerBlock];
+			if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+				encodeBC3AlphaBlock(block, dst);
+				dst += 8;
+			}
+			encodeBC1Block(block, dst);
+		}
+	}
+	return out;
+}
+
+//builds the full mip chain on the CPU and compresses it if asked to
+//RGB and opaque RGBA go to BC1 (4 bits a texel), RGBA with real alpha to BC3 (8 bits), anything else stays plain
+inline void bakeTexture(const Image& image, bool compress, BakedTexture& out) {
+	out.channels = image.channels;
+	out.format = imageFormat(image.channels);
+	if (compress && image.channels >= 3) {
+		bool opaque = true;
+		size_t texels = (size_t)image.width * image.height;
+		for (size_t i = 0; image.channels == 4 && opaque && i < texels; i++) {
+			opaque = image.pixels.get()[i * 4 + 3] == 255;
+		}
+		out.format = opaque ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	}
+	vector<int> widths, heights;
+	vector<unsigned char> previous;
+	const unsigned char* pixels = image.pixels.get();
+	int width = image.width, height = image.height;
+	for (;;) {
+		widths.push_back(width);
+		heights.push_back(height);
+		if (isCompressedFormat(out.format)) {
+			out.storage.push_back(compressLevel(pixels, width, height, image.channels, out.format));
+		} else {
+			out.storage.push_back(vector<unsigned char>(pixels, pixels + (size_t)width * height * image.channels));
+		}
+		if (width == 1 && height == 1) {
+			break;
+		}
+		previous = downsample(pixels, width, height, image.channels);
+		pixels = previous.data();
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	for (unsigned int i = 0; i < out.storage.size(); i++) {
+		TextureLevel level = { widths[i], heights[i], out.storage[i].data(), (uint32_t)out.storage[i].size() };
+		out.levels.push_back(level);
+	}
+}
+
+/* file layout, every field is 4 byte aligned so the levels can be uploaded straight out of the mapping
+ *   header     magic, version, GL format, channels, level count, padding, source hash (u64)
+ *   per level  width, height, byte size
+ *   per level  data (padded to 4)
+ */
+struct TextureCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;
+	uint32_t channels;
+	uint32_t levelCount;
+	uint32_t padding;
+	uint64_t sourceHash;
+};
+
+//a cache baked with compression counts as a miss when the driver can't take it
+inline bool readTextureCache(const string& cachePath, uint64_t sourceHash, bool allowCompressed, BakedTexture& out) {
+	if (!out.cacheFile.open(cachePath)) {
+		return false;
+	}
+	MappedFileReader reader(out.cacheFile.data(), out.cacheFile.size());
+	const unsigned char* headerBytes = reader.take(sizeof(TextureCacheHeader));
+	if (!headerBytes) {
+		out.cacheFile.close();
+		return false;
+	}
+	TextureCacheHeader header;
+	memcpy(&header, headerBytes, sizeof(header));
+	if (header.magic != TEXTURE_CACHE_MAGIC || header.version != TEXTURE_CACHE_VERSION || header.sourceHash != sourceHash ||
+		(isCompressedFormat(header.format) && !allowCompressed)) {
+		out.cacheFile.close();
+		return false;
+	}
+	//a full chain for anything a GPU takes is well under this, checked before it sizes an allocation
+	if (header.levelCount > TEXTURE_CACHE_MAX_LEVELS || (!isCompressedFormat(header.format) && (header.channels < 1 || header.channels > 4))) {
+		cout << "WARNING::TEXTURE_CACHE::CORRUPT " << cachePath << endl;
+		out.cacheFile.close();
+		return false;
+	}
+	vector<TextureLevel> levels(header.levelCount);
+	for (uint32_t i = 0; i < header.levelCount && reader.ok; i++) {
+		uint32_t width = reader.u32();
+		uint32_t height = reader.u32();
+		levels[i].width = (int)width;
+		levels[i].height = (int)height;
+		levels[i].size = reader.u32();
+		//the streamer divides by the row count and uploads size bytes for these dimensions, so they have to agree
+		if (width == 0 || height == 0 || width > 65536 || height > 65536 || levels[i].size != levelSize(header.format, (int)header.channels, width, height)) {
+			reader.ok = false;
+		}
+	}
+	for (uint32_t i = 0; i < header.levelCount && reader.ok; i++) {
+		levels[i].data = reader.take(levels[i].size);
+	}
+	if (!reader.ok || !reader.atEnd() || levels.empty()) {
+		cout << "WARNING::TEXTURE_CACHE::CORRUPT " << cachePath << endl;
+		out.cacheFile.close();
+		return false;
+	}
+	out.format = header.format;
+	out.channels = (int)header.channels;
+	out.levels = levels;
+	out.fromCache = true;
+	return true;
+}
+
+inline void writeTextureCache(const string& cachePath, uint64_t sourceHash, const BakedTexture& texture) {
+	ofstream file(cachePath, ios::binary | ios::trunc);
+	if (!file) {
+		cout << "WARNING::TEXTURE_CACHE::CANNOT_WRITE " << cachePath << endl;
+		return;
+	}
+	const char zeros[4] = { 0, 0, 0, 0 };
+	auto writeU32 = [&file](uint32_t value) {
+		file.write((const char*)&value, 4);
+	};
+	TextureCacheHeader header = { TEXTURE_CACHE_MAGIC, TEXTURE_CACHE_VERSION, texture.format, (uint32_t)texture.channels,
+		(uint32_t)texture.levels.size(), 0, sourceHash };
+	file.write((const char*)&header, sizeof(header));
+	for (unsigned int i = 0; i < texture.levels.size(); i++) {
+		writeU32((uint32_t)texture.levels[i].width);
+		writeU32((uint32_t)texture.levels[i].height);
+		writeU32(texture.levels[i].size);
+	}
+	for (unsigned int i = 0; i < texture.levels.size(); i++) {
+		file.write((const char*)texture.levels[i].data, texture.levels[i].size);
+		file.write(zeros, (4 - texture.levels[i].size % 4) % 4);
+	}
+	if (!file) {
+		cout << "WARNING::TEXTURE_CACHE::CANNOT_WRITE " << cachePath << endl;
+	}
+}
+
+#endif
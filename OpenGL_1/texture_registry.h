@@ -0,0 +1,152 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include "image.h"
+
+#include <cctype>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+//same spelling for every way of reaching a file, .\models\saturn\../saturn/rings.png -> models/saturn/rings.png
+inline string canonicalPath(const string& path) {
+	vector<string> parts;
+	size_t start = 0;
+	while (start <= path.size()) {
+		size_t end = path.find_first_of("\\/", start);
+		if (end == string::npos) {
+			end = path.size();
+		}
+		string part = path.substr(start, end - start);
+		if (part == "..") {
+			if (!parts.empty() && parts.back() != "..") {
+				parts.pop_back();
+			} else {
+				parts.push_back(part);
+			}
+		} else if (!part.empty() && part != ".") {
+			parts.push_back(part);
+		}
+		start = end + 1;
+	}
+	string result;
+	for (unsigned int i = 0; i < parts.size(); i++) {
+		if (i > 0) {
+			result += '/';
+		}
+		result += parts[i];
+	}
+#ifdef _WIN32
+	//windows doesn't care about case, so neither do we
+	for (unsigned int i = 0; i < result.size(); i++) {
+		result[i] = (char)tolower((unsigned char)result[i]);
+	}
+#endif
+	return result;
+}
+
+//every texture the process has loaded, found by canonical path or by content, so an image
+//used by several models (or copied next to each of them) is decoded and uploaded exactly once
+//textures are reference counted and deleted when the last model lets go of them
+class TextureRegistry {
+public:
+	//hands back the texture and takes a reference if the path or the content is already loaded
+	bool acquire(const string& path, const TextureInfo& info, unsigned int& id) {
+		requests++;
+		unordered_map<string, unsigned int>::iterator byPath = pathIndex.find(path);
+		unordered_map<uint64_t, unsigned int>::iterator byContent = info.contentHash != 0 ? contentIndex.find(info.contentHash) : contentIndex.end();
+		unsigned int texture;
+		if (byPath != pathIndex.end()) {
+			texture = byPath->second;
+		} else if (byContent != contentIndex.end()) {
+			//same pixels under another name, remember this name too
+			texture = byContent->second;
+			pathIndex[path] = texture;
+			entries[texture].paths.push_back(path);
+		} else {
+			return false;
+		}
+		entries[texture].refs++;
+		id = texture;
+		return true;
+	}
+	//registers a texture that was just created, with one reference held by the caller
+	//comes after an acquire() that missed, which already counted the request
+	void add(const string& path, const TextureInfo& info, unsigned int id) {
+		Entry& entry = entries[id];
+		entry.paths.push_back(path);
+		entry.contentHash = info.contentHash;
+		entry.bytes = textureBytes(info.width, info.height, info.channels);
+		entry.refs = 1;
+		pathIndex[path] = id;
+		if (info.contentHash != 0) {
+			contentIndex[info.contentHash] = id;
+		}
+		residentBytes += entry.bytes;
+	}
+	//swaps the size guessed from the image header for what actually went to the GPU, once that's known
+	void setBytes(unsigned int id, size_t bytes) {
+		unordered_map<unsigned int, Entry>::iterator it = entries.find(id);
+		if (it == entries.end()) {
+			return;
+		}
+		residentBytes += bytes - it->second.bytes;
+		it->second.bytes = bytes;
+	}
+	//GL thread only, deletes the texture once nobody uses it anymore
+	void release(unsigned int id) {
+		unordered_map<unsigned int, Entry>::iterator it = entries.find(id);
+		if (it == entries.end() || --it->second.refs > 0) {
+			return;
+		}
+		for (unsigned int i = 0; i < it->second.paths.size(); i++) {
+			pathIndex.erase(it->second.paths[i]);
+		}
+		contentIndex.erase(it->second.contentHash);
+		residentBytes -= it->second.bytes;
+		glDeleteTextures(1, &id);
+		entries.erase(it);
+	}
+
+	unsigned int uniqueCount() const {
+		return (unsigned int)entries.size();
+	}
+	unsigned int requestCount() const {
+		return requests;
+	}
+	//what the current duplicates would cost on the GPU if each had its own copy
+	size_t savedBytes() const {
+		size_t saved = 0;
+		for (unordered_map<unsigned int, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+			saved += (size_t)(it->second.refs - 1) * it->second.bytes;
+		}
+		return saved;
+	}
+	size_t gpuBytes() const {
+		return residentBytes;
+	}
+private:
+	struct Entry {
+		vector<string> paths;
+		uint64_t contentHash = 0;
+		size_t bytes = 0;
+		unsigned int refs = 0;
+	};
+	unordered_map<unsigned int, Entry> entries; //by GL texture name
+	unordered_map<string, unsigned int> pathIndex;
+	unordered_map<uint64_t, unsigned int> contentIndex;
+	unsigned int requests = 0;
+	size_t residentBytes = 0;
+};
+
+//textures are shared across every model, so there's one registry per process
+inline TextureRegistry& textureRegistry() {
+	static TextureRegistry registry;
+	return registry;
+}
+
+#endif
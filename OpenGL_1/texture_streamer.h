@@ -0,0 +1,279 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+
+#include "glm/glm.hpp"
+
+#include "thread_pool.h"
+#include "image.h"
+#include "gl_state.h"
+#include "hash.h"
+#include "texture_cache.h"
+#include "texture_registry.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <iostream>
+using namespace std;
+
+//hands out texture names right away, backed by a 1x1 placeholder, and fills them in over the next frames
+//workers map the baked .texcache, or decode, mip and compress the image and write one for next time,
+//update() then uploads the chain smallest level first within a byte budget and lowers GL_TEXTURE_BASE_LEVEL
+//as each level completes, so the texture sharpens in place and the id never changes
+class TextureStreamer {
+public:
+	//bytes the last update() sent to the GPU
+	size_t bytesLastUpdate = 0;
+	//images that came out of a .texcache vs ones that had to be baked
+	atomic<unsigned int> cacheHits{ 0 };
+	atomic<unsigned int> baked{ 0 };
+
+	//GL thread only, asks the driver about S3TC once up front so the workers never have to
+	explicit TextureStreamer(ThreadPool& pool) : pool(pool), compress(s3tcSupported()) {}
+	//the pool outlives us, so anything of ours still queued or decoding has to be done first
+	~TextureStreamer() {
+		pool.wait(work);
+	}
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	//GL thread only, repeat wrapping and trilinear filtering like TextureFromFile
+	unsigned int request2D(const string& path, glm::vec4 placeholder) {
+		return request(GL_TEXTURE_2D, vector<string>(1, path), placeholder);
+	}
+	//GL thread only, faces in GL order (+x, -x, +y, -y, +z, -z), clamped and linearly filtered
+	unsigned int requestCubemap(const vector<string>& faces, glm::vec4 placeholder) {
+		return request(GL_TEXTURE_CUBE_MAP, faces, placeholder);
+	}
+
+	//GL thread only, call once a frame, always makes some progress even on a tiny budget
+	size_t update(size_t budgetBytes) {
+		takeDecoded();
+		size_t uploaded = 0;
+		if (active.empty()) {
+			bytesLastUpdate = 0;
+			return 0;
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		while (!active.empty() && (uploaded < budgetBytes || uploaded == 0)) {
+			//smallest piece of work first, so everything gets its low mips before anything gets its big ones
+			unsigned int pick = 0;
+			for (unsigned int i = 1; i < active.size(); i++) {
+				if (levelBytes(*active[i], active[i]->level) < levelBytes(*active[pick], active[pick]->level)) {
+					pick = i;
+				}
+			}
+			uploaded += uploadSome(*active[pick], uploaded < budgetBytes ? budgetBytes - uploaded : 0);
+			if (active[pick]->level < 0) {
+				active.erase(active.begin() + pick);
+				inFlight--;
+			}
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		bytesLastUpdate = uploaded;
+		return uploaded;
+	}
+	//textures still decoding or uploading
+	unsigned int pending() const {
+		return inFlight;
+	}
+	bool idle() const {
+		return inFlight == 0;
+	}
+	bool compressing() const {
+		return compress;
+	}
+private:
+	struct StreamJob {
+		//BakedTexture owns a mapping and can't move, so the faces are sized once here
+		StreamJob(GLenum target, const vector<string>& paths) : target(target), paths(paths), faces(paths.size()) {}
+		GLenum target;
+		unsigned int id = 0;
+		vector<string> paths;
+		vector<BakedTexture> faces;
+		JobCounter decoding; //faces still decoding
+		int levels = 0;
+		GLenum format = GL_RGBA;
+		//upload cursor, level counts down to 0 and goes -1 once the whole chain is on the GPU
+		//rows are texel rows for plain formats and 4 texel block rows for compressed ones
+		int level = 0;
+		unsigned int face = 0;
+		int row = 0;
+	};
+
+	ThreadPool& pool;
+	bool compress; //bake to BC1/BC3
+	mutex decodedMutex;
+	vector<shared_ptr<StreamJob>> decoded; //finished on a worker, waiting for the GL thread
+	vector<shared_ptr<StreamJob>> active; //GL thread only
+	atomic<unsigned int> inFlight{ 0 };
+	JobCounter work; //every job we've put on the pool that hasn't run yet
+
+	unsigned int request(GLenum target, const vector<string>& paths, glm::vec4 placeholder) {
+		shared_ptr<StreamJob> job = make_shared<StreamJob>(target, paths);
+
+		unsigned char texel[4] = { (unsigned char)(placeholder.r * 255.f), (unsigned char)(placeholder.g * 255.f),
+			(unsigned char)(placeholder.b * 255.f), (unsigned char)(placeholder.a * 255.f) };
+		glGenTextures(1, &job->id);
+		glState().bindTexture(0, target, job->id);
+		for (unsigned int f = 0; f < paths.size(); f++) {
+			glTexImage2D(faceTarget(target, f), 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+		}
+		if (target == GL_TEXTURE_CUBE_MAP) {
+			glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		} else {
+			glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		}
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		//only the placeholder counts until the real levels are in
+		glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, 0);
+
+		inFlight++;
+		//faces decode side by side, the hand over to the GL thread waits on all of them
+		for (unsigned int f = 0; f < paths.size(); f++) {
+			pool.submit([this, job, f] {
+				loadFace(job->paths[f], job->faces[f]);
+			}, &job->decoding);
+		}
+		pool.submitAfter(job->decoding, [this, job] {
+			lock_guard<mutex> lock(decodedMutex);
+			decoded.push_back(job);
+		}, &work);
+		return job->id;
+	}
+
+	//worker side, the cache is keyed on the source file's bytes so editing the image rebakes it
+	void loadFace(const string& path, BakedTexture& face) {
+		vector<unsigned char> bytes;
+		if (!readFileBytes(path, bytes)) {
+			return;
+		}
+		uint64_t sourceHash = fnv1a(bytes.data(), bytes.size());
+		string cachePath = textureCachePath(path);
+		if (readTextureCache(cachePath, sourceHash, compress, face)) {
+			cacheHits++;
+			return;
+		}
+		Image image = decodeImage(bytes);
+		if (!image.valid()) {
+			return;
+		}
+		bakeTexture(image, compress, face);
+		writeTextureCache(cachePath, sourceHash, face);
+		baked++;
+	}
+
+	void takeDecoded() {
+		vector<shared_ptr<StreamJob>> ready;
+		{
+			lock_guard<mutex> lock(decodedMutex);
+			ready.swap(decoded);
+		}
+		for (unsigned int i = 0; i < ready.size(); i++) {
+			StreamJob& job = *ready[i];
+			const BakedTexture& first = job.faces[0];
+			bool ok = true;
+			for (unsigned int f = 0; f < job.faces.size(); f++) {
+				const BakedTexture& face = job.faces[f];
+				if (!face.valid()) {
+					std::cout << (job.target == GL_TEXTURE_CUBE_MAP ? "Cubemap failed to load at path: " : "Texture failed to load at path: ")
+						<< job.paths[f] << std::endl;
+					ok = false;
+				} else if (first.valid() && (face.format != first.format || face.levels.size() != first.levels.size() ||
+					face.levels[0].width != first.levels[0].width || face.levels[0].height != first.levels[0].height)) {
+					std::cout << "ERROR::TEXTURE_STREAMER::CUBEMAP_FACES_DIFFER " << job.paths[f] << std::endl;
+					ok = false;
+				}
+			}
+			if (!ok) {
+				inFlight--; //keeps its placeholder
+				continue;
+			}
+			job.format = first.format;
+			job.levels = (int)first.levels.size();
+			job.level = job.levels - 1;
+			textureRegistry().setBytes(job.id, first.gpuBytes() * job.faces.size());
+			active.push_back(ready[i]);
+		}
+	}
+
+	static GLenum faceTarget(GLenum target, unsigned int face) {
+		return target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target;
+	}
+	static size_t levelBytes(const StreamJob& job, int level) {
+		return job.faces[0].levels[level].size;
+	}
+
+	//uploads rows of the current face/level until the budget runs out, at least one row
+	size_t uploadSome(StreamJob& job, size_t budgetBytes) {
+		const TextureLevel& level = job.faces[job.face].levels[job.level];
+		bool compressed = isCompressedFormat(job.format);
+		int rowHeight = compressed ? 4 : 1;
+		int rowCount = (level.height + rowHeight - 1) / rowHeight;
+		size_t rowBytes = level.size / rowCount;
+		GLenum target = faceTarget(job.target, job.face);
+		glState().bindTexture(0, job.target, job.id);
+
+		size_t uploaded;
+		if (job.row == 0 && level.size <= budgetBytes) {
+			if (compressed) {
+				glCompressedTexImage2D(target, job.level, job.format, level.width, level.height, 0, level.size, level.data);
+			} else {
+				glTexImage2D(target, job.level, job.format, level.width, level.height, 0, job.format, GL_UNSIGNED_BYTE, level.data);
+			}
+			job.row = rowCount;
+			uploaded = level.size;
+		} else {
+			if (job.row == 0) {
+				if (compressed) {
+					glCompressedTexImage2D(target, job.level, job.format, level.width, level.height, 0, level.size, NULL);
+				} else {
+					glTexImage2D(target, job.level, job.format, level.width, level.height, 0, job.format, GL_UNSIGNED_BYTE, NULL);
+				}
+			}
+			int rows = (int)(budgetBytes / rowBytes);
+			if (rows < 1) {
+				rows = 1;
+			}
+			if (rows > rowCount - job.row) {
+				rows = rowCount - job.row;
+			}
+			int y = job.row * rowHeight;
+			int height = rows * rowHeight < level.height - y ? rows * rowHeight : level.height - y;
+			const unsigned char* data = level.data + job.row * rowBytes;
+			if (compressed) {
+				glCompressedTexSubImage2D(target, job.level, 0, y, level.width, height, job.format, (GLsizei)(rows * rowBytes), data);
+			} else {
+				glTexSubImage2D(target, job.level, 0, y, level.width, height, job.format, GL_UNSIGNED_BYTE, data);
+			}
+			job.row += rows;
+			uploaded = rowBytes * rows;
+		}
+
+		if (job.row == rowCount) {
+			job.row = 0;
+			job.face++;
+			if (job.face == job.faces.size()) {
+				//every face has this level now, let sampling use it
+				glTexParameteri(job.target, GL_TEXTURE_MAX_LEVEL, job.levels - 1);
+				glTexParameteri(job.target, GL_TEXTURE_BASE_LEVEL, job.level);
+				job.face = 0;
+				job.level--;
+			}
+		}
+		return uploaded;
+	}
+};
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+using namespace std;
+
+class ThreadPool;
+
+//counts jobs that haven't finished yet, wait on it or hang more jobs off it with submitAfter
+//has to outlive every job it's counting
+class JobCounter {
+public:
+	JobCounter() {}
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool done() const {
+		return pending.load(memory_order_acquire) == 0;
+	}
+	unsigned int count() const {
+		return pending.load(memory_order_relaxed);
+	}
+private:
+	friend class ThreadPool;
+	atomic<unsigned int> pending{ 0 };
+	mutex lock;
+	condition_variable finished;
+	vector<pair<function<void()>, JobCounter*>> continuations; //jobs waiting for this to hit zero
+};
+
+//one shared set of workers for everything, loading, simulation, the belt and culling
+//every worker has its own deque, it pushes and pops at the back while idle workers steal from the front,
+//so a worker stays on the work it just split up and only takes someone else's oldest, biggest jobs
+//threads that aren't workers can wait() too, they help by running jobs of the counter they're waiting on
+//jobs must not touch GL, only the main thread has a context
+class ThreadPool {
+public:
+	//cumulative, the ui turns them into utilisation
+	struct WorkerStats {
+		double busySeconds;
+		uint64_t jobs;
+		uint64_t steals;
+	};
+
+	//defaults to one worker per core, minus the main thread
+	explicit ThreadPool(unsigned int threadCount = 0) {
+		if (threadCount == 0) {
+			unsigned int cores = thread::hardware_concurrency();
+			threadCount = cores > 1 ? cores - 1 : 1;
+		}
+		for (unsigned int i = 0; i <= threadCount; i++) {
+			workers.push_back(unique_ptr<Worker>(new Worker()));
+		}
+		for (unsigned int i = 0; i < threadCount; i++) {
+			threads.push_back(thread([this, i] { workerLoop(i); }));
+		}
+	}
+	~ThreadPool() {
+		shutdown();
+	}
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	//finishes every queued job and joins the workers, for owners that need them gone before their other members
+	void shutdown() {
+		{
+			lock_guard<mutex> lock(sleepMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (unsigned int i = 0; i < threads.size(); i++) {
+			threads[i].join();
+		}
+		threads.clear();
+	}
+
+	//counter, if there is one, goes up now and down once the job has run
+	void submit(function<void()> job, JobCounter* counter = NULL) {
+		if (counter) {
+			counter->pending++;
+		}
+		push(Task{ move(job), counter });
+	}
+	//job only gets queued once dependency is done, straight away if it already is
+	void submitAfter(JobCounter& dependency, function<void()> job, JobCounter* counter = NULL) {
+		if (counter) {
+			counter->pending++;
+		}
+		{
+			lock_guard<mutex> lock(dependency.lock);
+			if (dependency.pending != 0) {
+				dependency.continuations.push_back(make_pair(move(job), counter));
+				return;
+			}
+		}
+		push(Task{ move(job), counter });
+	}
+	//runs the counter's own jobs while any are queued, only sleeps once the rest are running elsewhere
+	void wait(JobCounter& counter) {
+		unsigned int self = currentWorker();
+		while (!counter.done()) {
+			if (runOne(self, &counter)) {
+				continue;
+			}
+			//a running job might still queue more for this counter, so check back every so often
+			unique_lock<mutex> lock(counter.lock);
+			counter.finished.wait_for(lock, chrono::microseconds(500), [&counter] { return counter.pending == 0; });
+		}
+		//finish() may still be inside the counter's lock, the caller can't throw it away until it's out
+		lock_guard<mutex> lock(counter.lock);
+	}
+	//splits [0, count) into chunks of grain, the calling thread works through them alongside the workers
+	//and only returns once every chunk is done, so it never deadlocks even if the workers are all busy
+	void parallelFor(unsigned int count, unsigned int grain, function<void(unsigned int, unsigned int)> body) {
+		if (count == 0) {
+			return;
+		}
+		//on the stack is fine, wait() doesn't return till the last helper has let go of it
+		ParallelFor work;
+		work.count = count;
+		work.grain = grain;
+		work.chunks = (count + grain - 1) / grain;
+		work.body = move(body);
+		JobCounter helpers;
+		unsigned int helperCount = work.chunks - 1 < size() ? work.chunks - 1 : size();
+		for (unsigned int i = 0; i < helperCount; i++) {
+			submit([&work] { work.run(); }, &helpers);
+		}
+		work.run();
+		wait(helpers);
+	}
+	//workers, not counting the outside threads' slot, fixed before any of them start
+	unsigned int size() const {
+		return (unsigned int)workers.size() - 1;
+	}
+	//one entry per worker and a last one for every other thread that ran jobs while waiting
+	void stats(vector<WorkerStats>& out) const {
+		out.resize(workers.size());
+		for (unsigned int i = 0; i < workers.size(); i++) {
+			out[i].busySeconds = workers[i]->busyNanoseconds.load(memory_order_relaxed) * 1e-9;
+			out[i].jobs = workers[i]->jobs.load(memory_order_relaxed);
+			out[i].steals = workers[i]->steals.load(memory_order_relaxed);
+		}
+	}
+private:
+	struct Task {
+		function<void()> run;
+		JobCounter* counter;
+	};
+	struct Worker {
+		mutex lock;
+		deque<Task> tasks; //only the last Worker, the one for outside threads, never queues anything
+		atomic<uint64_t> busyNanoseconds{ 0 };
+		atomic<uint64_t> jobs{ 0 };
+		atomic<uint64_t> steals{ 0 };
+	};
+	struct ParallelFor {
+		unsigned int count = 0;
+		unsigned int grain = 1;
+		unsigned int chunks = 0;
+		function<void(unsigned int, unsigned int)> body;
+		atomic<unsigned int> next{ 0 };
+
+		void run() {
+			for (;;) {
+				unsigned int chunk = next++;
+				if (chunk >= chunks) {
+					return;
+				}
+				unsigned int begin = chunk * grain;
+				body(begin, begin + grain < count ? begin + grain : count);
+			}
+		}
+	};
+
+	vector<unique_ptr<Worker>> workers;
+	vector<thread> threads;
+	atomic<int> queued{ 0 }; //tasks sitting in deques, can dip below zero for a moment while a push lands
+	atomic<unsigned int> nextQueue{ 0 }; //round robin for submits from outside threads
+	mutex sleepMutex;
+	condition_variable wake;
+	bool stopping = false;
+
+	//which worker the calling thread is in this pool, size() for any other thread
+	unsigned int currentWorker() const {
+		const pair<const ThreadPool*, unsigned int>& id = workerId();
+		return id.first == this ? id.second : size();
+	}
+	static pair<const ThreadPool*, unsigned int>& workerId() {
+		static thread_local pair<const ThreadPool*, unsigned int> id((const ThreadPool*)NULL, 0u);
+		return id;
+	}
+
+	void push(Task task) {
+		unsigned int self = currentWorker();
+		Worker& target = self < size() ? *workers[self] : *workers[nextQueue++ % size()];
+		{
+			lock_guard<mutex> lock(target.lock);
+			target.tasks.push_back(move(task));
+		}
+		queued++;
+		//taking the lock means a worker between checking queued and going to sleep can't miss this
+		{
+			lock_guard<mutex> lock(sleepMutex);
+		}
+		wake.notify_one();
+	}
+	//own deque from the back first, then steal from everyone else's front starting next door
+	//only set, only tasks counted by it are taken, so a wait never ends up stuck behind someone's model import
+	bool take(unsigned int self, const JobCounter* only, Task& task, bool& stolen) {
+		unsigned int n = size();
+		if (self < n && takeFrom(*workers[self], only, false, task)) {
+			stolen = false;
+			return true;
+		}
+		for (unsigned int k = 1; k <= n; k++) {
+			unsigned int victim = (self + k) % n;
+			if (victim != self && takeFrom(*workers[victim], only, true, task)) {
+				stolen = true;
+				return true;
+			}
+		}
+		return false;
+	}
+	bool takeFrom(Worker& worker, const JobCounter* only, bool front, Task& task) {
+		lock_guard<mutex> lock(worker.lock);
+		deque<Task>& tasks = worker.tasks;
+		for (unsigned int k = 0; k < tasks.size(); k++) {
+			unsigned int i = front ? k : (unsigned int)tasks.size() - 1 - k;
+			if (only && tasks[i].counter != only) {
+				continue;
+			}
+			task = move(tasks[i]);
+			tasks.erase(tasks.begin() + i);
+			queued--;
+			return true;
+		}
+		return false;
+	}
+	bool runOne(unsigned int self, const JobCounter* only) {
+		Task task;
+		bool stolen = false;
+		if (!take(self, only, task, stolen)) {
+			return false;
+		}
+		Worker& stats = *workers[self];
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		task.run();
+		stats.busyNanoseconds += (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+		stats.jobs++;
+		if (stolen) {
+			stats.steals++;
+		}
+		if (task.counter) {
+			finish(*task.counter);
+		}
+		return true;
+	}
+	void finish(JobCounter& counter) {
+		vector<pair<function<void()>, JobCounter*>> ready;
+		{
+			lock_guard<mutex> lock(counter.lock);
+			if (--counter.pending == 0) {
+				ready.swap(counter.continuations);
+				counter.finished.notify_all();
+			}
+		}
+		//their counters already went up in submitAfter
+		for (unsigned int i = 0; i < ready.size(); i++) {
+			push(Task{ move(ready[i].first), ready[i].second });
+		}
+	}
+
+	void workerLoop(unsigned int self) {
+		workerId() = make_pair((const ThreadPool*)this, self);
+		for (;;) {
+			if (runOne(self, NULL)) {
+				continue;
+			}
+			unique_lock<mutex> lock(sleepMutex);
+			wake.wait(lock, [this] { return stopping || queued > 0; });
+			if (stopping && queued <= 0) {
+				return;
+			}
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+using namespace std;
+
+//hands the latest value from one writer thread to one reader thread, neither side ever waits on the other
+//three slots: the writer fills its back slot and swaps it into the middle, the reader swaps the middle out
+//for its front slot whenever something new is there, the middle's index and a fresh bit share one atomic
+//slots get reused rather than rebuilt, so vectors inside T keep their capacity and stop allocating
+template <class T>
+class TripleBuffer {
+public:
+	//writer only, fill it in then publish()
+	T& back() {
+		return slots[backIndex];
+	}
+	void publish() {
+		unsigned int previous = middle.exchange(backIndex | FRESH, memory_order_acq_rel);
+		backIndex = previous & INDEX;
+	}
+	//reader only, takes the newest published value if there is one, returns whether front() changed
+	bool update() {
+		if ((middle.load(memory_order_relaxed) & FRESH) == 0) {
+			return false;
+		}
+		unsigned int previous = middle.exchange(frontIndex, memory_order_acq_rel);
+		frontIndex = previous & INDEX;
+		return true;
+	}
+	const T& front() const {
+		return slots[frontIndex];
+	}
+private:
+	static const unsigned int INDEX = 3;
+	static const unsigned int FRESH = 4;
+	T slots[3];
+	unsigned int backIndex = 0; //writer's
+	unsigned int frontIndex = 1; //reader's
+	atomic<unsigned int> middle{ 2 };
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include "glm/glm.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+//how a model's vertices sit in GPU memory, picked per model when it's loaded, each has its own arena and VAO
+enum VertexFormat {
+	VERTEX_FULL, //Vertex, plain floats
+	VERTEX_COMPACT, //CompactVertex, half the size
+	VERTEX_FORMATS
+};
+
+struct Vertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::vec2 TexCoords;
+};
+
+//16 bytes instead of 32, decoded in the vertex shaders:
+//  position  16 bit unorm across the model's bounding box, the box goes in as positionOffset/positionScale
+//  normal    octahedral, the unit sphere folded flat onto a square, 16 bit snorm each way
+//  uv        half floats
+struct CompactVertex {
+	uint16_t position[3];
+	uint16_t pad;
+	int16_t normal[2];
+	uint16_t texCoords[2];
+};
+static_assert(sizeof(CompactVertex) == 16, "CompactVertex has to stay tightly packed");
+
+//what a compact model's positions need to get back to model space, pos = offset + stored * scale
+//full models use offset 0 and scale 1, so every draw sets it whatever the format
+struct VertexDecode {
+	glm::vec3 offset = glm::vec3(0.f);
+	glm::vec3 scale = glm::vec3(1.f);
+	bool octNormals = false;
+};
+
+//worst case over a whole model, printed at import
+struct CompactReport {
+	float position = 0.f; //model units
+	float normalDegrees = 0.f;
+	float texCoord = 0.f;
+};
+
+namespace VertexPacking {
+	inline uint16_t halfFromFloat(float value) {
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+		int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+		uint32_t mantissa = bits & 0x7FFFFF;
+		if (exponent >= 31) {
+			if (((bits >> 23) & 0xFF) == 0xFF && mantissa != 0) {
+				return sign | 0x7E00 | (uint16_t)(mantissa >> 13); //NaN stays NaN, the quiet bit keeps the mantissa nonzero
+			}
+			return sign | 0x7C00; //too big, infinity
+		}
+		if (exponent <= 0) {
+			if (exponent < -10) {
+				return sign; //too small, zero
+			}
+			//subnormal, the implicit bit becomes explicit and shifts down
+			mantissa |= 0x800000;
+			uint32_t shift = (uint32_t)(14 - exponent);
+			uint32_t half = mantissa >> shift;
+			uint32_t rest = mantissa & ((1u << shift) - 1);
+			uint32_t halfway = 1u << (shift - 1);
+			if (rest > halfway || (rest == halfway && (half & 1))) {
+				half++;
+			}
+			return sign | (uint16_t)half;
+		}
+		uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+		uint32_t rest = mantissa & 0x1FFF;
+		//round to nearest even, a carry into the exponent is still the right answer
+		if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+			half++;
+		}
+		return sign | (uint16_t)half;
+	}
+	inline float floatFromHalf(uint16_t half) {
+		uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+		uint32_t exponent = (half >> 10) & 0x1F;
+		uint32_t mantissa = half & 0x3FF;
+		uint32_t bits;
+		if (exponent == 0) {
+			float value = mantissa * (1.f / 16777216.f); //2^-24
+			return sign ? -value : value;
+		}
+		if (exponent == 31) {
+			bits = sign | 0x7F800000 | (mantissa << 13);
+		} else {
+			bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+		}
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+	inline int16_t snorm16(float value) {
+		return (int16_t)lroundf(glm::clamp(value, -1.f, 1.f) * 32767.f);
+	}
+	//how GL 4.2 and up turn a normalized short back into a float
+	inline float fromSnorm16(int16_t value) {
+		return glm::max(value / 32767.f, -1.f);
+	}
+	//the rule before 4.2, which a 3.3 context is allowed to use, never quite reaches 0
+	inline float fromSnorm16Legacy(int16_t value) {
+		return (2.f * value + 1.f) / 65535.f;
+	}
+	//projects onto the octahedron |x| + |y| + |z| = 1 and folds the bottom half over the top
+	inline glm::vec2 octEncode(glm::vec3 n) {
+		n /= fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+		glm::vec2 e = glm::vec2(n.x, n.y);
+		if (n.z < 0.f) {
+			e = glm::vec2((1.f - fabsf(n.y)) * (n.x >= 0.f ? 1.f : -1.f), (1.f - fabsf(n.x)) * (n.y >= 0.f ? 1.f : -1.f));
+		}
+		return e;
+	}
+	//the same as decodeNormal() in shaders/vertex_decode.glsl
+	inline glm::vec3 octDecode(glm::vec2 e) {
+		glm::vec3 n = glm::vec3(e.x, e.y, 1.f - fabsf(e.x) - fabsf(e.y));
+		if (n.z < 0.f) {
+			n = glm::vec3((1.f - fabsf(e.y)) * (e.x >= 0.f ? 1.f : -1.f), (1.f - fabsf(e.x)) * (e.y >= 0.f ? 1.f : -1.f), n.z);
+		}
+		return glm::normalize(n);
+	}
+}
+
+//packs count vertices against the box min to max, and widens report to the worst error it ran into
+inline void compactVertices(const Vertex* vertices, unsigned int count, const glm::vec3& min, const glm::vec3& max,
+	vector<CompactVertex>& out, CompactReport& report) {
+	using namespace VertexPacking;
+	glm::vec3 extent = max - min;
+	out.resize(count);
+	for (unsigned int i = 0; i < count; i++) {
+		const Vertex& v = vertices[i];
+		CompactVertex& c = out[i];
+		glm::vec3 decoded;
+		for (int a = 0; a < 3; a++) {
+			float t = extent[a] > 0.f ? (v.Position[a] - min[a]) / extent[a] : 0.f;
+			c.position[a] = (uint16_t)lroundf(glm::clamp(t, 0.f, 1.f) * 65535.f);
+			decoded[a] = min[a] + c.position[a] / 65535.f * extent[a];
+		}
+		c.pad = 0;
+		report.position = glm::max(report.position, glm::length(decoded - v.Position));
+
+		float length = glm::length(v.Normal);
+		glm::vec3 normal = length > 0.f ? v.Normal / length : glm::vec3(0.f, 0.f, 1.f);
+		glm::vec2 e = octEncode(normal);
+		c.normal[0] = snorm16(e.x);
+		c.normal[1] = snorm16(e.y);
+		//the driver picks the snorm rule, so the report takes whichever of the two is worse
+		glm::vec3 back = octDecode(glm::vec2(fromSnorm16(c.normal[0]), fromSnorm16(c.normal[1])));
+		glm::vec3 backLegacy = octDecode(glm::vec2(fromSnorm16Legacy(c.normal[0]), fromSnorm16Legacy(c.normal[1])));
+		float cosine = glm::min(glm::dot(back, normal), glm::dot(backLegacy, normal));
+		float angle = acosf(glm::clamp(cosine, -1.f, 1.f)) * 57.2957795f;
+		report.normalDegrees = glm::max(report.normalDegrees, angle);
+
+		for (int a = 0; a < 2; a++) {
+			c.texCoords[a] = halfFromFloat(v.TexCoords[a]);
+			report.texCoord = glm::max(report.texCoord, fabsf(floatFromHalf(c.texCoords[a]) - v.TexCoords[a]));
+		}
+	}
+}
+
+#endif